@@ -0,0 +1,57 @@
+#!/usr/bin/env ruby
+#
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Measures result throughput for each batch_size. Each record batch is
+# summed by Apache Arrow compute to show per-batch overhead in
+# downstream processing.
+#
+# Usage: ruby -I lib -I ext/arrow-duckdb benchmark/batch-size.rb
+
+require "benchmark"
+
+require "arrow-duckdb"
+
+n_rows = Integer(ENV["N_ROWS"] || 10_000_000)
+batch_sizes = [nil, 8192, 65536, 1048576]
+sum = Arrow::Function.find("sum")
+
+DuckDB::Database.open do |db|
+  db.connect do |connection|
+    connection.query(<<-SQL)
+CREATE TABLE data AS
+  SELECT range AS id, range % 10 AS value
+  FROM range(#{n_rows})
+    SQL
+
+    batch_sizes.each do |batch_size|
+      result = connection.query("SELECT * FROM data",
+                                output: :arrow,
+                                batch_size: batch_size)
+      n_batches = 0
+      elapsed = Benchmark.realtime do
+        result.each do |record_batch|
+          n_batches += 1
+          sum.execute([record_batch["value"].data])
+        end
+      end
+      puts("batch_size=%-8s: %6d batches: %12.0f rows/s" % [
+             batch_size || "default",
+             n_batches,
+             n_rows / elapsed,
+           ])
+    end
+  end
+end
@@ -0,0 +1,67 @@
+#!/usr/bin/env ruby
+#
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Compares ingest throughput of Connection#insert_arrow with
+# registering a table and running INSERT INTO ... SELECT.
+#
+# Usage: ruby -I lib -I ext/arrow-duckdb benchmark/ingest.rb
+
+require "benchmark"
+require "tmpdir"
+
+require "arrow-duckdb"
+
+n_rows = Integer(ENV["N_ROWS"] || 10_000_000)
+n_loads = Integer(ENV["N_LOADS"] || 10)
+
+Dir.mktmpdir do |dir|
+  DuckDB::Database.open(File.join(dir, "ingest.duckdb")) do |db|
+    db.connect do |connection|
+      table = connection.query(<<-SQL, output: :arrow).to_table
+SELECT range AS id, random() AS value, range % 100 AS category
+  FROM range(#{n_rows / n_loads})
+      SQL
+      # All columns are 8 bytes.
+      n_bytes = table.n_rows * table.n_columns * 8
+      approaches = {
+        "register + INSERT" => lambda do
+          connection.register("source", table) do
+            connection.query("INSERT INTO data SELECT * FROM source")
+          end
+        end,
+        "insert_arrow" => lambda do
+          connection.insert_arrow("data", table)
+        end,
+      }
+      approaches.each do |label, load|
+        connection.query("DROP TABLE IF EXISTS data")
+        connection.query(<<-SQL)
+CREATE TABLE data (id BIGINT, value DOUBLE, category BIGINT)
+        SQL
+        elapsed = Benchmark.realtime do
+          n_loads.times do
+            load.call
+          end
+        end
+        puts("%-17s: %12.0f rows/s: %8.1f MB/s" % [
+               label,
+               table.n_rows * n_loads / elapsed,
+               n_bytes * n_loads / elapsed / 1024 / 1024,
+             ])
+      end
+    end
+  end
+end
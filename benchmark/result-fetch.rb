@@ -0,0 +1,51 @@
+#!/usr/bin/env ruby
+#
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Measures per ArrowDuckDB::Result#fetch cost for small record batches.
+#
+# Usage: ruby -I lib -I ext/arrow-duckdb benchmark/result-fetch.rb
+
+require "benchmark"
+
+require "arrow-duckdb"
+
+n_rows = Integer(ENV["N_ROWS"] || 10_000_000)
+
+DuckDB::Database.open do |db|
+  db.connect do |connection|
+    connection.query(<<-SQL)
+CREATE TABLE data AS
+  SELECT range AS id, range % 10 AS value
+  FROM range(#{n_rows})
+    SQL
+
+    [false, true].each do |stream|
+      result = connection.query("SELECT * FROM data",
+                                output: :arrow,
+                                stream: stream)
+      n_batches = 0
+      elapsed = Benchmark.realtime do
+        n_batches += 1 while result.fetch
+      end
+      label = stream ? "stream" : "materialized"
+      puts("%-12s: %8d batches: %8.3fus/fetch" % [
+             label,
+             n_batches,
+             elapsed * 1_000_000 / n_batches,
+           ])
+    end
+  end
+end
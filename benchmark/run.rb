@@ -0,0 +1,211 @@
+#!/usr/bin/env ruby
+#
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Runs benchmarks of hot paths of the Apache Arrow <-> DuckDB bridge
+# against synthetic datasets. The datasets are computed from row
+# numbers. So they're the same on every run.
+#
+# Each result is printed as a JSON line. Use OUTPUT=results.jsonl to
+# write them to a file too. Compare results of versions by "name".
+#
+# "peak_rss_kb" is the peak RSS of the process so far. It's nil on
+# platforms without /proc. "result_n_bytes" of "result: strings: *"
+# is the size of the result to compare memory usage of string types.
+#
+# Usage: rake benchmark
+#        ruby benchmark/run.rb [NAME_PATTERN]
+
+require "json"
+require "pathname"
+
+base_dir = Pathname.new(__FILE__).dirname.parent.expand_path
+
+ext_dir = base_dir + "ext" + "arrow-duckdb"
+lib_dir = base_dir + "lib"
+
+$LOAD_PATH.unshift(ext_dir.to_s)
+$LOAD_PATH.unshift(lib_dir.to_s)
+
+require "arrow-duckdb"
+
+n_rows = Integer(ENV["N_ROWS"] || 10_000_000)
+n_operations = Integer(ENV["N_OPERATIONS"] || 10_000)
+pattern = Regexp.new(ARGV[0] || "")
+output = ENV["OUTPUT"] ? File.open(ENV["OUTPUT"], "a") : nil
+
+def peak_rss_kb
+  status = "/proc/self/status"
+  return nil unless File.exist?(status)
+  File.foreach(status) do |line|
+    return Integer(line.split[1]) if line.start_with?("VmHWM:")
+  end
+  nil
+end
+
+def measure(name, n_rows: nil, n_bytes: nil, n_operations: nil)
+  GC.start
+  n_allocations_before = GC.stat(:total_allocated_objects)
+  start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  yield
+  elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+  n_allocations = GC.stat(:total_allocated_objects) - n_allocations_before
+  result = {
+    name: name,
+    version: ArrowDuckDB::VERSION,
+    elapsed: elapsed,
+    n_allocations: n_allocations,
+    peak_rss_kb: peak_rss_kb,
+  }
+  if n_rows
+    result[:n_rows] = n_rows
+    result[:rows_per_second] = n_rows / elapsed
+  end
+  if n_bytes
+    result[:n_bytes] = n_bytes
+    result[:mb_per_second] = n_bytes / elapsed / 1024 / 1024
+  end
+  if n_operations
+    result[:n_operations] = n_operations
+    result[:us_per_operation] = elapsed / n_operations * 1_000_000
+  end
+  result
+end
+
+benchmarks = {}
+
+# All columns are 8 bytes.
+data_sql = <<-SQL
+SELECT range AS id,
+       (range * 7919) % 1000000 / 1000000.0 AS value,
+       range % 100 AS category
+  FROM range(#{n_rows})
+SQL
+n_bytes = n_rows * 3 * 8
+
+benchmarks["result: each"] = lambda do |connection, table|
+  measure("result: each", n_rows: n_rows, n_bytes: n_bytes) do
+    connection.query_sql_arrow(data_sql).each {}
+  end
+end
+
+benchmarks["result: to_table"] = lambda do |connection, table|
+  measure("result: to_table", n_rows: n_rows, n_bytes: n_bytes) do
+    connection.query_sql_arrow(data_sql).to_table
+  end
+end
+
+benchmarks["result: stream"] = lambda do |connection, table|
+  measure("result: stream", n_rows: n_rows, n_bytes: n_bytes) do
+    connection.query_sql_arrow(data_sql, stream: true).each {}
+  end
+end
+
+# A low-cardinality VARCHAR column.
+strings_sql = <<-SQL
+SELECT ['Japan', 'United States', 'Germany', 'France'][range % 4 + 1] AS country
+  FROM range(#{n_rows})
+SQL
+
+[:string, :large_string, :string_view, :dictionary].each do |strings|
+  name = "result: strings: #{strings}"
+  benchmarks[name] = lambda do |connection, table|
+    result_table = nil
+    result = measure(name, n_rows: n_rows) do
+      result_table =
+        connection.query_sql_arrow(strings_sql, strings: strings).to_table
+    end
+    # The IPC stream format is almost the same as the memory layout.
+    buffer = Arrow::ResizableBuffer.new(0)
+    result_table.save(buffer, format: :arrows)
+    result[:result_n_bytes] = buffer.size
+    result
+  end
+end
+
+benchmarks["scan: full"] = lambda do |connection, table|
+  connection.register("data", table) do
+    measure("scan: full", n_rows: n_rows, n_bytes: n_bytes) do
+      connection.query_sql_arrow("SELECT sum(value) FROM data").to_table
+    end
+  end
+end
+
+benchmarks["scan: pushdown"] = lambda do |connection, table|
+  connection.register("data", table) do
+    sql = "SELECT sum(value) FROM data WHERE category = 29"
+    measure("scan: pushdown", n_rows: n_rows, n_bytes: n_bytes) do
+      connection.query_sql_arrow(sql).to_table
+    end
+  end
+end
+
+benchmarks["scan: no pushdown"] = lambda do |connection, table|
+  connection.register("data", table) do
+    # DuckDB can't push down a filter with an expression.
+    sql = "SELECT sum(value) FROM data WHERE category + 0 = 29"
+    measure("scan: no pushdown", n_rows: n_rows, n_bytes: n_bytes) do
+      connection.query_sql_arrow(sql).to_table
+    end
+  end
+end
+
+benchmarks["prepared statement: latency"] = lambda do |connection, table|
+  statement =
+    DuckDB::PreparedStatement.new(connection, "SELECT ? + 1 AS number")
+  measure("prepared statement: latency", n_operations: n_operations) do
+    n_operations.times do |i|
+      statement.bind(1, i)
+      statement.execute_arrow.to_table
+    end
+  end
+end
+
+benchmarks["register: register + unregister"] = lambda do |connection, table|
+  small_table = Arrow::Table.new("id" => [1, 2, 3])
+  measure("register: register + unregister",
+          n_operations: n_operations) do
+    n_operations.times do
+      connection.register("small", small_table)
+      connection.query_sql_arrow("SELECT * FROM small").to_table
+      connection.unregister_arrow("small")
+    end
+  end
+end
+
+benchmarks["register: arrow_sources"] = lambda do |connection, table|
+  small_table = Arrow::Table.new("id" => [1, 2, 3])
+  measure("register: arrow_sources", n_operations: n_operations) do
+    n_operations.times do
+      connection.arrow_sources["small"] = small_table
+      connection.query_sql_arrow("SELECT * FROM small").to_table
+      connection.arrow_sources.delete("small")
+    end
+  end
+end
+
+DuckDB::Database.open do |db|
+  db.connect do |connection|
+    table = nil
+    benchmarks.each do |name, benchmark|
+      next unless pattern.match?(name)
+      table ||= connection.query_sql_arrow(data_sql).to_table
+      line = benchmark.call(connection, table).to_json
+      puts(line)
+      output&.puts(line)
+    end
+  end
+end
+output&.close
@@ -0,0 +1,59 @@
+#!/usr/bin/env ruby
+#
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Compares registered table scan throughput with 1 thread and N
+# threads. Use N_ROWS=200000000 for a multi-GB table.
+#
+# A registered table is split into partitions. Each DuckDB's thread
+# scans its own partitions. So N threads run pushed down filters,
+# projections and conversions in parallel.
+#
+# Usage: ruby -I lib -I ext/arrow-duckdb benchmark/scan-threads.rb
+
+require "benchmark"
+require "etc"
+
+require "arrow-duckdb"
+
+n_rows = Integer(ENV["N_ROWS"] || 50_000_000)
+n_threads = [1, Integer(ENV["N_THREADS"] || Etc.nprocessors)].uniq
+
+DuckDB::Database.open do |db|
+  db.connect do |connection|
+    table = connection.query(<<-SQL, output: :arrow).to_table
+SELECT range AS id, random() AS value FROM range(#{n_rows})
+    SQL
+    connection.register("data", table) do
+      queries = {
+        "full scan" => "SELECT SUM(value) FROM data",
+        "pushdown" => "SELECT SUM(value) FROM data WHERE value < 0.1",
+      }
+      queries.each do |label, sql|
+        n_threads.each do |n|
+          connection.query("SET threads = #{n}")
+          elapsed = Benchmark.realtime do
+            connection.query(sql, output: :arrow).to_table
+          end
+          puts("%-9s: threads=%-3d: %12.0f rows/s" % [
+                 label,
+                 n,
+                 n_rows / elapsed,
+               ])
+        end
+      end
+    end
+  end
+end
@@ -0,0 +1,53 @@
+#!/usr/bin/env ruby
+#
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Measures latency of many short queries against a small registered
+# table. Per-scan setup such as building the dataset and converting
+# pushed filters is a large part of the latency of such queries.
+# "same filter" reuses the cached filter. "different filters" misses
+# the cache on each query.
+#
+# Usage: ruby -I lib -I ext/arrow-duckdb benchmark/short-queries.rb
+
+require "benchmark"
+
+require "arrow-duckdb"
+
+n_rows = Integer(ENV["N_ROWS"] || 10_000)
+n_queries = Integer(ENV["N_QUERIES"] || 10_000)
+
+DuckDB::Database.open do |db|
+  db.connect do |connection|
+    table = connection.query(<<-SQL, output: :arrow).to_table
+SELECT range AS id, range % 100 AS category FROM range(#{n_rows})
+    SQL
+    connection.register("data", table) do
+      sql = "SELECT count(*) FROM data WHERE category IN (1, 2, 3) AND id > "
+      labels = {
+        "same filter" => ->(i) {sql + "10"},
+        "different filters" => ->(i) {sql + i.to_s},
+      }
+      labels.each do |label, build_sql|
+        elapsed = Benchmark.realtime do
+          n_queries.times do |i|
+            connection.query(build_sql.call(i), output: :arrow).to_table
+          end
+        end
+        puts("%-17s: %8.1f us/query" % [label, elapsed / n_queries * 1_000_000])
+      end
+    end
+  end
+end
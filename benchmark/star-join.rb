@@ -0,0 +1,70 @@
+#!/usr/bin/env ruby
+#
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Compares a star schema join of registered tables with and without
+# statistics. With statistics, DuckDB's optimizer knows which table is
+# small and builds the hash table from it.
+#
+# Usage: ruby -I lib -I ext/arrow-duckdb benchmark/star-join.rb
+
+require "benchmark"
+
+require "arrow-duckdb"
+
+n_rows = Integer(ENV["N_ROWS"] || 10_000_000)
+n_customers = Integer(ENV["N_CUSTOMERS"] || 100_000)
+n_products = Integer(ENV["N_PRODUCTS"] || 1_000)
+
+DuckDB::Database.open do |db|
+  db.connect do |connection|
+    sales = connection.query(<<-SQL, output: :arrow).to_table
+SELECT range AS id,
+       (random() * #{n_customers})::BIGINT AS customer_id,
+       (random() * #{n_products})::BIGINT AS product_id,
+       random() * 100 AS amount
+  FROM range(#{n_rows})
+    SQL
+    customers = connection.query(<<-SQL, output: :arrow).to_table
+SELECT range AS id, 'region' || (range % 10) AS region
+  FROM range(#{n_customers})
+    SQL
+    products = connection.query(<<-SQL, output: :arrow).to_table
+SELECT range AS id, 'category' || (range % 20) AS category
+  FROM range(#{n_products})
+    SQL
+    sql = <<-SQL
+SELECT customers.region, products.category, sum(sales.amount)
+  FROM products
+       JOIN sales ON sales.product_id = products.id
+       JOIN customers ON sales.customer_id = customers.id
+ WHERE products.id < 10
+ GROUP BY customers.region, products.category
+    SQL
+    [false, true].each do |statistics|
+      elapsed = nil
+      connection.register("sales", sales, statistics: statistics) do
+        connection.register("customers", customers, statistics: statistics) do
+          connection.register("products", products, statistics: statistics) do
+            elapsed = Benchmark.realtime do
+              connection.query(sql, output: :arrow).to_table
+            end
+          end
+        end
+      end
+      puts("statistics=%-5s: %8.3f s" % [statistics, elapsed])
+    end
+  end
+end
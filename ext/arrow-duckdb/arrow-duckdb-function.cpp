@@ -0,0 +1,290 @@
+/*
+ * Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arrow/c/bridge.h>
+#include <arrow/compute/api.h>
+
+#include <duckdb.hpp>
+#ifndef DUCKDB_AMALGAMATION
+#  include <duckdb.h>
+#  include <duckdb/catalog/catalog.hpp>
+#  include <duckdb/catalog/catalog_entry/schema_catalog_entry.hpp>
+#  include <duckdb/common/arrow/arrow_converter.hpp>
+#  include <duckdb/function/scalar_function.hpp>
+#  include <duckdb/main/client_context.hpp>
+#  include <duckdb/main/connection.hpp>
+#  include <duckdb/main/database.hpp>
+#  include <duckdb/parser/parsed_data/create_scalar_function_info.hpp>
+#endif
+
+#include "arrow-duckdb-function.hpp"
+#include "arrow-duckdb-gvl.hpp"
+
+namespace {
+  // Returns nullptr for unsupported types.
+  std::shared_ptr<arrow::DataType>
+  output_arrow_type(const duckdb::LogicalType &type)
+  {
+    switch (type.id()) {
+    case duckdb::LogicalTypeId::BOOLEAN:
+      return arrow::boolean();
+    case duckdb::LogicalTypeId::TINYINT:
+      return arrow::int8();
+    case duckdb::LogicalTypeId::SMALLINT:
+      return arrow::int16();
+    case duckdb::LogicalTypeId::INTEGER:
+      return arrow::int32();
+    case duckdb::LogicalTypeId::BIGINT:
+      return arrow::int64();
+    case duckdb::LogicalTypeId::UTINYINT:
+      return arrow::uint8();
+    case duckdb::LogicalTypeId::USMALLINT:
+      return arrow::uint16();
+    case duckdb::LogicalTypeId::UINTEGER:
+      return arrow::uint32();
+    case duckdb::LogicalTypeId::UBIGINT:
+      return arrow::uint64();
+    case duckdb::LogicalTypeId::FLOAT:
+      return arrow::float32();
+    case duckdb::LogicalTypeId::DOUBLE:
+      return arrow::float64();
+    case duckdb::LogicalTypeId::VARCHAR:
+      return arrow::utf8();
+    case duckdb::LogicalTypeId::DATE:
+      return arrow::date32();
+    case duckdb::LogicalTypeId::TIMESTAMP:
+      return arrow::timestamp(arrow::TimeUnit::MICRO);
+    default:
+      return nullptr;
+    }
+  }
+
+  template <typename ArrowArray, typename Value>
+  void
+  write_values(const arrow::Array &array, duckdb::Vector &result)
+  {
+    const auto &typed_array = static_cast<const ArrowArray &>(array);
+    auto data = duckdb::FlatVector::GetData<Value>(result);
+    auto &validity = duckdb::FlatVector::Validity(result);
+    for (int64_t i = 0; i < array.length(); ++i) {
+      if (typed_array.IsNull(i)) {
+        validity.SetInvalid(i);
+      } else {
+        data[i] = static_cast<Value>(typed_array.Value(i));
+      }
+    }
+  }
+
+  void
+  write_strings(const arrow::Array &array, duckdb::Vector &result)
+  {
+    const auto &string_array = static_cast<const arrow::StringArray &>(array);
+    auto data = duckdb::FlatVector::GetData<duckdb::string_t>(result);
+    auto &validity = duckdb::FlatVector::Validity(result);
+    for (int64_t i = 0; i < array.length(); ++i) {
+      if (string_array.IsNull(i)) {
+        validity.SetInvalid(i);
+      } else {
+        auto value = string_array.GetView(i);
+        data[i] = duckdb::StringVector::AddString(result,
+                                                  value.data(),
+                                                  value.size());
+      }
+    }
+  }
+
+  // array must be output_arrow_type(result.GetType()).
+  void
+  write_output(const arrow::Array &array, duckdb::Vector &result)
+  {
+    result.SetVectorType(duckdb::VectorType::FLAT_VECTOR);
+    switch (result.GetType().id()) {
+    case duckdb::LogicalTypeId::BOOLEAN:
+      write_values<arrow::BooleanArray, bool>(array, result);
+      break;
+    case duckdb::LogicalTypeId::TINYINT:
+      write_values<arrow::Int8Array, int8_t>(array, result);
+      break;
+    case duckdb::LogicalTypeId::SMALLINT:
+      write_values<arrow::Int16Array, int16_t>(array, result);
+      break;
+    case duckdb::LogicalTypeId::INTEGER:
+      write_values<arrow::Int32Array, int32_t>(array, result);
+      break;
+    case duckdb::LogicalTypeId::BIGINT:
+      write_values<arrow::Int64Array, int64_t>(array, result);
+      break;
+    case duckdb::LogicalTypeId::UTINYINT:
+      write_values<arrow::UInt8Array, uint8_t>(array, result);
+      break;
+    case duckdb::LogicalTypeId::USMALLINT:
+      write_values<arrow::UInt16Array, uint16_t>(array, result);
+      break;
+    case duckdb::LogicalTypeId::UINTEGER:
+      write_values<arrow::UInt32Array, uint32_t>(array, result);
+      break;
+    case duckdb::LogicalTypeId::UBIGINT:
+      write_values<arrow::UInt64Array, uint64_t>(array, result);
+      break;
+    case duckdb::LogicalTypeId::FLOAT:
+      write_values<arrow::FloatArray, float>(array, result);
+      break;
+    case duckdb::LogicalTypeId::DOUBLE:
+      write_values<arrow::DoubleArray, double>(array, result);
+      break;
+    case duckdb::LogicalTypeId::VARCHAR:
+      write_strings(array, result);
+      break;
+    case duckdb::LogicalTypeId::DATE:
+      {
+        const auto &date_array = static_cast<const arrow::Date32Array &>(array);
+        auto data = duckdb::FlatVector::GetData<duckdb::date_t>(result);
+        auto &validity = duckdb::FlatVector::Validity(result);
+        for (int64_t i = 0; i < array.length(); ++i) {
+          if (date_array.IsNull(i)) {
+            validity.SetInvalid(i);
+          } else {
+            data[i] = duckdb::date_t(date_array.Value(i));
+          }
+        }
+      }
+      break;
+    case duckdb::LogicalTypeId::TIMESTAMP:
+      {
+        const auto &timestamp_array =
+          static_cast<const arrow::TimestampArray &>(array);
+        auto data = duckdb::FlatVector::GetData<duckdb::timestamp_t>(result);
+        auto &validity = duckdb::FlatVector::Validity(result);
+        for (int64_t i = 0; i < array.length(); ++i) {
+          if (timestamp_array.IsNull(i)) {
+            validity.SetInvalid(i);
+          } else {
+            data[i] = duckdb::timestamp_t(timestamp_array.Value(i));
+          }
+        }
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  arrow::Result<arrow::ArrayVector>
+  import_args(duckdb::DataChunk &args, duckdb::ClientContext &context)
+  {
+    auto properties = context.GetClientProperties();
+    duckdb::vector<std::string> names;
+    for (duckdb::idx_t i = 0; i < args.ColumnCount(); ++i) {
+      names.push_back("arg" + std::to_string(i));
+    }
+    ArrowSchema c_abi_schema;
+    duckdb::ArrowConverter::ToArrowSchema(&c_abi_schema,
+                                          args.GetTypes(),
+                                          names,
+                                          properties);
+    ArrowArray c_abi_array;
+    duckdb::ArrowConverter::ToArrowArray(args, &c_abi_array, properties);
+    ARROW_ASSIGN_OR_RAISE(auto record_batch,
+                          arrow::ImportRecordBatch(&c_abi_array,
+                                                   &c_abi_schema));
+    return record_batch->columns();
+  }
+
+  arrow::Status
+  execute(const arrow_duckdb::ScalarFunction &function,
+          const std::shared_ptr<arrow::DataType> &output_type,
+          duckdb::DataChunk &args,
+          duckdb::ExpressionState &state,
+          duckdb::Vector &result)
+  {
+    ARROW_ASSIGN_OR_RAISE(auto arrow_args,
+                          import_args(args, state.GetContext()));
+    auto n_rows = static_cast<int64_t>(args.size());
+    auto gvl_released = arrow_duckdb::context_gvl_released(state.GetContext());
+    ARROW_ASSIGN_OR_RAISE(auto output,
+                          function(arrow_args, n_rows, gvl_released));
+    if (output->length() != n_rows) {
+      return arrow::Status::Invalid(
+        "[arrow-duckdb][function] the number of output rows must be ",
+        "the number of input rows: ",
+        "expected: <", n_rows, ">: ",
+        "actual: <", output->length(), ">");
+    }
+    if (!output->type()->Equals(output_type)) {
+      ARROW_ASSIGN_OR_RAISE(output, arrow::compute::Cast(*output, output_type));
+    }
+    write_output(*output, result);
+    return arrow::Status::OK();
+  }
+}
+
+namespace arrow_duckdb {
+  void
+  connection_register_scalar_function(duckdb_connection connection,
+                                      const std::string &name,
+                                      const std::vector<std::string> &arg_types,
+                                      const std::string &return_type,
+                                      ScalarFunction function)
+  {
+    duckdb::vector<duckdb::LogicalType> duckdb_arg_types;
+    for (const auto &arg_type : arg_types) {
+      duckdb_arg_types.push_back(duckdb::TransformStringToLogicalType(arg_type));
+    }
+    auto duckdb_return_type = duckdb::TransformStringToLogicalType(return_type);
+    auto output_type = output_arrow_type(duckdb_return_type);
+    if (!output_type) {
+      throw duckdb::NotImplementedException(
+        "[arrow-duckdb][function][%s] not implemented return type: %s",
+        name,
+        duckdb_return_type.ToString());
+    }
+
+    duckdb::ScalarFunction scalar_function(
+      name,
+      duckdb_arg_types,
+      duckdb_return_type,
+      [function, output_type](duckdb::DataChunk &args,
+                              duckdb::ExpressionState &state,
+                              duckdb::Vector &result) {
+        auto status = execute(function, output_type, args, state, result);
+        if (!status.ok()) {
+          throw duckdb::InvalidInputException(status.ToString());
+        }
+      });
+    // NULL inputs are passed to function as is.
+    scalar_function.null_handling =
+      duckdb::FunctionNullHandling::SPECIAL_HANDLING;
+
+    auto duckdb_connection = reinterpret_cast<duckdb::Connection *>(connection);
+    auto &db = duckdb::DatabaseInstance::GetDatabase(*(duckdb_connection->context));
+    auto &catalog = duckdb::Catalog::GetSystemCatalog(db);
+    auto transaction = duckdb::CatalogTransaction::GetSystemTransaction(db);
+    // REPLACE_ON_CONFLICT below must not replace DuckDB's functions
+    // such as lower() for all connections.
+    auto &schema = catalog.GetSchema(transaction, DEFAULT_SCHEMA);
+    auto entry = schema.GetEntry(transaction,
+                                 duckdb::CatalogType::SCALAR_FUNCTION_ENTRY,
+                                 name);
+    if (entry && entry->internal) {
+      throw duckdb::InvalidInputException(
+        "[arrow-duckdb][function][%s] can't replace built-in function",
+        name);
+    }
+    duckdb::CreateScalarFunctionInfo info(std::move(scalar_function));
+    info.on_conflict = duckdb::OnCreateConflict::REPLACE_ON_CONFLICT;
+    catalog.CreateFunction(transaction, info);
+  }
+}
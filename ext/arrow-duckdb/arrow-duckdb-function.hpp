@@ -0,0 +1,48 @@
+/*
+ * Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <arrow/api.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace arrow_duckdb {
+  // Computes the output vector of a chunk from the input vectors. This
+  // may be called by any DuckDB thread concurrently. gvl_released is
+  // whether the Ruby thread that runs the query doesn't have the
+  // GVL. See GVLReleasedScope.
+  using ScalarFunction =
+    std::function<arrow::Result<std::shared_ptr<arrow::Array>>(
+                    const arrow::ArrayVector &args,
+                    int64_t n_rows,
+                    bool gvl_released)>;
+
+  // Registers a scalar function that receives input vectors as
+  // Apache Arrow arrays. Types are DuckDB type names such as
+  // "BIGINT". The function is registered to the system catalog. So
+  // all connections of the database can use it and registering the
+  // same name again replaces it. DuckDB's built-in functions can't be
+  // replaced. This throws an exception on error.
+  void
+  connection_register_scalar_function(duckdb_connection connection,
+                                      const std::string &name,
+                                      const std::vector<std::string> &arg_types,
+                                      const std::string &return_type,
+                                      ScalarFunction function);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+
+#include <duckdb.hpp>
+#ifndef DUCKDB_AMALGAMATION
+#  include <duckdb.h>
+#  include <duckdb/main/client_context.hpp>
+#  include <duckdb/main/client_context_state.hpp>
+#  include <duckdb/main/connection.hpp>
+#endif
+
+#include "arrow-duckdb-gvl.hpp"
+
+namespace {
+  // Per connection state for GVLReleasedScope.
+  class GVLState : public duckdb::ClientContextState {
+  public:
+    static constexpr const char *key = "arrow_duckdb_gvl";
+
+    GVLState() : n_released_scopes(0) {}
+
+    // Scopes may be nested such as a streaming fetch in a query.
+    std::atomic<int> n_released_scopes;
+  };
+}
+
+namespace arrow_duckdb {
+  struct GVLReleasedScope::State {
+    duckdb::shared_ptr<GVLState> gvl_state;
+  };
+
+  GVLReleasedScope::GVLReleasedScope(duckdb_connection connection)
+    : state_(std::make_unique<State>())
+  {
+    auto duckdb_connection = reinterpret_cast<duckdb::Connection *>(connection);
+    auto &context = *(duckdb_connection->context);
+    auto gvl_state = context.registered_state->Get<GVLState>(GVLState::key);
+    if (!gvl_state) {
+      gvl_state = duckdb::make_shared_ptr<GVLState>();
+      context.registered_state->Insert(GVLState::key, gvl_state);
+    }
+    ++(gvl_state->n_released_scopes);
+    state_->gvl_state = std::move(gvl_state);
+  }
+
+  GVLReleasedScope::~GVLReleasedScope()
+  {
+    --(state_->gvl_state->n_released_scopes);
+  }
+
+  bool
+  context_gvl_released(duckdb::ClientContext &context)
+  {
+    auto gvl_state = context.registered_state->Get<GVLState>(GVLState::key);
+    return gvl_state && gvl_state->n_released_scopes > 0;
+  }
+}
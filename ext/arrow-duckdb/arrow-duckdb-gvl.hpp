@@ -0,0 +1,45 @@
+/*
+ * Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+
+namespace duckdb {
+  class ClientContext;
+}
+
+namespace arrow_duckdb {
+  // Marks that the Ruby thread that runs queries of connection
+  // doesn't have the GVL while this is alive. DuckDB's worker threads
+  // can wait for Ruby only while this is alive. Otherwise, they wait
+  // for the GVL held by the Ruby thread that waits for them.
+  //
+  // This doesn't use Ruby API. So this can be used without the GVL.
+  class GVLReleasedScope {
+  public:
+    explicit GVLReleasedScope(duckdb_connection connection);
+    ~GVLReleasedScope();
+
+  private:
+    struct State;
+    std::unique_ptr<State> state_;
+  };
+
+  // Whether GVLReleasedScope of the connection of context is alive.
+  bool
+  context_gvl_released(duckdb::ClientContext &context);
+}
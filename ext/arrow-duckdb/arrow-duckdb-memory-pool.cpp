@@ -0,0 +1,351 @@
+/*
+ * Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arrow/c/bridge.h>
+#include <arrow/memory_pool.h>
+#include <arrow/util/byte_size.h>
+
+#include <list>
+#include <mutex>
+
+#include <duckdb.hpp>
+#ifndef DUCKDB_AMALGAMATION
+#  include <duckdb.h>
+#  include <duckdb/main/client_context.hpp>
+#  include <duckdb/main/client_context_state.hpp>
+#  include <duckdb/main/connection.hpp>
+#endif
+
+#include "arrow-duckdb-memory-pool.hpp"
+
+namespace {
+  // Per connection state for memory pools.
+  class MemoryPoolState : public duckdb::ClientContextState {
+  public:
+    static constexpr const char *key = "arrow_duckdb_memory_pool";
+
+    explicit MemoryPoolState(
+      std::shared_ptr<arrow_duckdb::TrackingMemoryPool> pool)
+      : mutex_(),
+        pool_(std::move(pool)),
+        query_pools_()
+    {
+    }
+
+    using QueryPools =
+      std::list<std::shared_ptr<arrow_duckdb::TrackingMemoryPool>>;
+
+    // The pool of the latest query or the pool for the connection.
+    std::shared_ptr<arrow_duckdb::TrackingMemoryPool>
+    current()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (query_pools_.empty()) {
+        return pool_;
+      }
+      return query_pools_.back();
+    }
+
+    // Scopes may overlap without nesting such as a streaming result
+    // fetched while another query runs. So each scope removes only
+    // its own pool by the returned iterator.
+    QueryPools::iterator
+    add_query_pool(std::shared_ptr<arrow_duckdb::TrackingMemoryPool> pool)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return query_pools_.insert(query_pools_.end(), std::move(pool));
+    }
+
+    void
+    remove_query_pool(QueryPools::iterator it)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      query_pools_.erase(it);
+    }
+
+  private:
+    std::mutex mutex_;
+    std::shared_ptr<arrow_duckdb::TrackingMemoryPool> pool_;
+    QueryPools query_pools_;
+  };
+
+  // The original array moved by import_tracked_record_batch().
+  struct TrackedArray {
+    ArrowArray array;
+    std::shared_ptr<arrow_duckdb::TrackingMemoryPool> pool;
+    // 0 until the import succeeds.
+    int64_t n_bytes;
+  };
+
+  void
+  tracked_array_release(ArrowArray *array)
+  {
+    auto tracked = static_cast<TrackedArray *>(array->private_data);
+    if (tracked->array.release) {
+      tracked->array.release(&(tracked->array));
+    }
+    if (tracked->n_bytes > 0) {
+      tracked->pool->release(tracked->n_bytes);
+    }
+    delete tracked;
+    array->release = nullptr;
+  }
+}
+
+namespace arrow_duckdb {
+  TrackingMemoryPool::TrackingMemoryPool(arrow::MemoryPool *backend,
+                                         int64_t limit)
+    : backend_(backend),
+      parent_(),
+      limit_(limit)
+  {
+  }
+
+  TrackingMemoryPool::TrackingMemoryPool(
+    std::shared_ptr<TrackingMemoryPool> parent,
+    int64_t limit)
+    : backend_(parent->backend_),
+      parent_(std::move(parent)),
+      limit_(limit)
+  {
+  }
+
+  arrow::Status
+  TrackingMemoryPool::Allocate(int64_t size, int64_t alignment, uint8_t **out)
+  {
+    ARROW_RETURN_NOT_OK(reserve(size));
+    auto status = backend_->Allocate(size, alignment, out);
+    if (!status.ok()) {
+      release(size);
+      return status;
+    }
+    count_allocation(size);
+    return arrow::Status::OK();
+  }
+
+  arrow::Status
+  TrackingMemoryPool::Reallocate(int64_t old_size,
+                                 int64_t new_size,
+                                 int64_t alignment,
+                                 uint8_t **ptr)
+  {
+    auto diff = new_size - old_size;
+    if (diff > 0) {
+      ARROW_RETURN_NOT_OK(reserve(diff));
+    }
+    auto status = backend_->Reallocate(old_size, new_size, alignment, ptr);
+    if (!status.ok()) {
+      if (diff > 0) {
+        release(diff);
+      }
+      return status;
+    }
+    if (diff > 0) {
+      count_allocation(diff);
+    } else if (diff < 0) {
+      release(-diff);
+    }
+    return arrow::Status::OK();
+  }
+
+  void
+  TrackingMemoryPool::Free(uint8_t *buffer, int64_t size, int64_t alignment)
+  {
+    backend_->Free(buffer, size, alignment);
+    release(size);
+  }
+
+  arrow::Status
+  TrackingMemoryPool::reserve(int64_t size)
+  {
+    auto bytes_allocated = bytes_allocated_.fetch_add(size) + size;
+    auto limit = limit_.load();
+    if (limit >= 0 && bytes_allocated > limit) {
+      bytes_allocated_ -= size;
+      return arrow::Status::OutOfMemory(
+        "[arrow-duckdb][memory-pool] memory limit exceeded: ",
+        "failed to allocate ", size, " bytes: ",
+        bytes_allocated - size, "/", limit, " bytes are used");
+    }
+    if (parent_) {
+      auto status = parent_->reserve(size);
+      if (!status.ok()) {
+        bytes_allocated_ -= size;
+        return status;
+      }
+    }
+    auto max_memory = max_memory_.load();
+    while (bytes_allocated > max_memory &&
+           !max_memory_.compare_exchange_weak(max_memory, bytes_allocated)) {
+    }
+    return arrow::Status::OK();
+  }
+
+  void
+  TrackingMemoryPool::release(int64_t size)
+  {
+    bytes_allocated_ -= size;
+    if (parent_) {
+      parent_->release(size);
+    }
+  }
+
+  void
+  TrackingMemoryPool::count_allocation(int64_t size)
+  {
+    for (auto pool = this; pool; pool = pool->parent_.get()) {
+      pool->total_bytes_allocated_ += size;
+      pool->num_allocations_++;
+    }
+  }
+
+  arrow::Result<arrow::MemoryPool *>
+  backend_memory_pool(const std::string &name)
+  {
+    if (name.empty()) {
+      return arrow::default_memory_pool();
+    } else if (name == "system") {
+      return arrow::system_memory_pool();
+    }
+    arrow::MemoryPool *pool = nullptr;
+    if (name == "jemalloc") {
+      ARROW_RETURN_NOT_OK(arrow::jemalloc_memory_pool(&pool));
+    } else if (name == "mimalloc") {
+      ARROW_RETURN_NOT_OK(arrow::mimalloc_memory_pool(&pool));
+    } else {
+      return arrow::Status::Invalid(
+        "[arrow-duckdb][memory-pool] unknown backend: ", name);
+    }
+    return pool;
+  }
+
+  void
+  connection_set_memory_pool(duckdb_connection connection,
+                             std::shared_ptr<TrackingMemoryPool> pool)
+  {
+    auto duckdb_connection = reinterpret_cast<duckdb::Connection *>(connection);
+    auto &context = *(duckdb_connection->context);
+    context.registered_state->Remove(MemoryPoolState::key);
+    if (!pool) {
+      return;
+    }
+    context.registered_state->Insert(
+      MemoryPoolState::key,
+      duckdb::make_shared_ptr<MemoryPoolState>(std::move(pool)));
+  }
+
+  std::shared_ptr<TrackingMemoryPool>
+  context_memory_pool(duckdb::ClientContext &context)
+  {
+    auto state =
+      context.registered_state->Get<MemoryPoolState>(MemoryPoolState::key);
+    if (!state) {
+      return nullptr;
+    }
+    return state->current();
+  }
+
+  struct ConnectionMemoryPoolRef::State {
+    duckdb::shared_ptr<MemoryPoolState> memory_pool_state;
+  };
+
+  ConnectionMemoryPoolRef::ConnectionMemoryPoolRef(
+    duckdb_connection connection)
+    : state_(std::make_unique<State>())
+  {
+    auto duckdb_connection = reinterpret_cast<duckdb::Connection *>(connection);
+    state_->memory_pool_state =
+      duckdb_connection->context->registered_state->Get<MemoryPoolState>(
+        MemoryPoolState::key);
+  }
+
+  ConnectionMemoryPoolRef::~ConnectionMemoryPoolRef() = default;
+
+  struct QueryMemoryPoolScope::State {
+    duckdb::shared_ptr<MemoryPoolState> memory_pool_state;
+    MemoryPoolState::QueryPools::iterator query_pool;
+
+    State(duckdb::shared_ptr<MemoryPoolState> memory_pool_state,
+          std::shared_ptr<TrackingMemoryPool> pool)
+      : memory_pool_state(std::move(memory_pool_state)),
+        query_pool()
+    {
+      query_pool =
+        this->memory_pool_state->add_query_pool(std::move(pool));
+    }
+
+    ~State()
+    {
+      memory_pool_state->remove_query_pool(query_pool);
+    }
+  };
+
+  QueryMemoryPoolScope::QueryMemoryPoolScope(
+    duckdb_connection connection,
+    std::shared_ptr<TrackingMemoryPool> pool)
+    : state_()
+  {
+    if (!pool) {
+      return;
+    }
+    auto duckdb_connection = reinterpret_cast<duckdb::Connection *>(connection);
+    auto memory_pool_state =
+      duckdb_connection->context->registered_state->Get<MemoryPoolState>(
+        MemoryPoolState::key);
+    if (memory_pool_state) {
+      state_ = std::make_unique<State>(std::move(memory_pool_state),
+                                       std::move(pool));
+    }
+  }
+
+  QueryMemoryPoolScope::QueryMemoryPoolScope(
+    const ConnectionMemoryPoolRef &ref,
+    std::shared_ptr<TrackingMemoryPool> pool)
+    : state_()
+  {
+    if (pool && ref.state_->memory_pool_state) {
+      state_ = std::make_unique<State>(ref.state_->memory_pool_state,
+                                       std::move(pool));
+    }
+  }
+
+  QueryMemoryPoolScope::~QueryMemoryPoolScope() = default;
+
+  arrow::Result<std::shared_ptr<arrow::RecordBatch>>
+  import_tracked_record_batch(ArrowArray *array,
+                              const std::shared_ptr<arrow::Schema> &schema,
+                              std::shared_ptr<TrackingMemoryPool> pool)
+  {
+    if (!pool) {
+      return arrow::ImportRecordBatch(array, schema);
+    }
+    // Move array to tracked. tracked is deleted when the imported
+    // record batch is released.
+    auto tracked = new TrackedArray{*array, std::move(pool), 0};
+    array->release = nullptr;
+    auto tracked_array = tracked->array;
+    tracked_array.private_data = tracked;
+    tracked_array.release = tracked_array_release;
+    ARROW_ASSIGN_OR_RAISE(auto record_batch,
+                          arrow::ImportRecordBatch(&tracked_array, schema));
+    // DuckDB has already allocated the buffers. So this can't prevent
+    // the allocation. It fails the query after the fact instead.
+    auto n_bytes = arrow::util::TotalBufferSize(*record_batch);
+    ARROW_RETURN_NOT_OK(tracked->pool->reserve(n_bytes));
+    tracked->n_bytes = n_bytes;
+    return record_batch;
+  }
+}
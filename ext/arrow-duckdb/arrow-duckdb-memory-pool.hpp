@@ -0,0 +1,145 @@
+/*
+ * Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <arrow/api.h>
+#include <arrow/c/abi.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace duckdb {
+  class ClientContext;
+}
+
+namespace arrow_duckdb {
+  // A memory pool that counts allocated bytes and fails allocations
+  // over its limit. A child pool such as a pool for a query forwards
+  // allocations to its parent such as a pool for a connection. So
+  // the parent also counts them and applies its limit.
+  class TrackingMemoryPool : public arrow::MemoryPool {
+  public:
+    // limit < 0 means no limit.
+    TrackingMemoryPool(arrow::MemoryPool *backend, int64_t limit);
+    TrackingMemoryPool(std::shared_ptr<TrackingMemoryPool> parent,
+                       int64_t limit);
+
+    using arrow::MemoryPool::Allocate;
+    using arrow::MemoryPool::Free;
+    using arrow::MemoryPool::Reallocate;
+
+    arrow::Status
+    Allocate(int64_t size, int64_t alignment, uint8_t **out) override;
+    arrow::Status
+    Reallocate(int64_t old_size,
+               int64_t new_size,
+               int64_t alignment,
+               uint8_t **ptr) override;
+    void
+    Free(uint8_t *buffer, int64_t size, int64_t alignment) override;
+    void ReleaseUnused() override { backend_->ReleaseUnused(); }
+    int64_t bytes_allocated() const override { return bytes_allocated_; }
+    int64_t max_memory() const override { return max_memory_; }
+    int64_t total_bytes_allocated() const override {
+      return total_bytes_allocated_;
+    }
+    int64_t num_allocations() const override { return num_allocations_; }
+    std::string backend_name() const override {
+      return backend_->backend_name();
+    }
+
+    int64_t limit() const { return limit_; }
+    void set_limit(int64_t limit) { limit_ = limit; }
+
+    // Counts size bytes not allocated by this pool such as DuckDB's
+    // result. This fails with arrow::Status::OutOfMemory over the
+    // limit of this pool or its ancestors.
+    arrow::Status reserve(int64_t size);
+    void release(int64_t size);
+
+  private:
+    arrow::MemoryPool *backend_;
+    std::shared_ptr<TrackingMemoryPool> parent_;
+    std::atomic<int64_t> limit_;
+    std::atomic<int64_t> bytes_allocated_{0};
+    std::atomic<int64_t> max_memory_{0};
+    std::atomic<int64_t> total_bytes_allocated_{0};
+    std::atomic<int64_t> num_allocations_{0};
+
+    void count_allocation(int64_t size);
+  };
+
+  // name is "system", "jemalloc", "mimalloc" or "" for Apache Arrow's
+  // default. jemalloc and mimalloc are available only when Apache
+  // Arrow C++ is built with them.
+  arrow::Result<arrow::MemoryPool *>
+  backend_memory_pool(const std::string &name);
+
+  // Scans of registered Apache Arrow data by queries of connection
+  // allocate from pool. nullptr pool uses Apache Arrow's default.
+  void
+  connection_set_memory_pool(duckdb_connection connection,
+                             std::shared_ptr<TrackingMemoryPool> pool);
+  // The pool for the running query or the pool for the connection
+  // of context. nullptr when not set.
+  std::shared_ptr<TrackingMemoryPool>
+  context_memory_pool(duckdb::ClientContext &context);
+
+  // Refers the memory pools of a connection. They are still
+  // available after the connection is closed. A streaming result
+  // uses this for fetching because it may be fetched after its
+  // connection is closed.
+  class ConnectionMemoryPoolRef {
+  public:
+    explicit ConnectionMemoryPoolRef(duckdb_connection connection);
+    ~ConnectionMemoryPoolRef();
+
+  private:
+    friend class QueryMemoryPoolScope;
+    struct State;
+    std::unique_ptr<State> state_;
+  };
+
+  // Scans started while this is alive allocate from pool instead of
+  // the pool for the connection. The pool of the latest alive scope
+  // is used when scopes overlap. This does nothing when pool is
+  // nullptr.
+  class QueryMemoryPoolScope {
+  public:
+    QueryMemoryPoolScope(duckdb_connection connection,
+                         std::shared_ptr<TrackingMemoryPool> pool);
+    // For fetching a streaming result.
+    QueryMemoryPoolScope(const ConnectionMemoryPoolRef &ref,
+                         std::shared_ptr<TrackingMemoryPool> pool);
+    ~QueryMemoryPoolScope();
+
+  private:
+    struct State;
+    std::unique_ptr<State> state_;
+  };
+
+  // Imports array allocated by DuckDB. Its bytes are counted by pool
+  // until the returned record batch is released. This fails over
+  // the limit of pool. The bytes are counted after DuckDB allocated
+  // them. So the usage may exceed the limit by one record batch
+  // before the failure.
+  arrow::Result<std::shared_ptr<arrow::RecordBatch>>
+  import_tracked_record_batch(ArrowArray *array,
+                              const std::shared_ptr<arrow::Schema> &schema,
+                              std::shared_ptr<TrackingMemoryPool> pool);
+}
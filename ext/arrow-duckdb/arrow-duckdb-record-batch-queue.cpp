@@ -0,0 +1,111 @@
+/*
+ * Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "arrow-duckdb-record-batch-queue.hpp"
+
+namespace arrow_duckdb {
+  RecordBatchQueue::RecordBatchQueue(std::shared_ptr<arrow::Schema> schema,
+                                     size_t capacity)
+    : mutex_(),
+      condition_(),
+      schema_(std::move(schema)),
+      record_batches_(),
+      capacity_(std::max(capacity, static_cast<size_t>(1))),
+      closed_(false),
+      status_()
+  {
+  }
+
+  std::shared_ptr<arrow::Schema>
+  RecordBatchQueue::schema() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return schema_;
+  }
+
+  arrow::Status
+  RecordBatchQueue::ReadNext(std::shared_ptr<arrow::RecordBatch> *record_batch)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [&] {
+      return closed_ || !record_batches_.empty();
+    });
+    if (record_batches_.empty()) {
+      record_batch->reset();
+      return status_;
+    }
+    *record_batch = std::move(record_batches_.front());
+    record_batches_.pop_front();
+    condition_.notify_all();
+    return arrow::Status::OK();
+  }
+
+  arrow::Result<bool>
+  RecordBatchQueue::push(std::shared_ptr<arrow::RecordBatch> record_batch)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!schema_) {
+      schema_ = record_batch->schema();
+      condition_.notify_all();
+    } else if (!record_batch->schema()->Equals(*schema_, false)) {
+      return arrow::Status::Invalid(
+        "[arrow-duckdb][record-batch-queue][push] schema mismatch: ",
+        "expected: <", schema_->ToString(), ">: ",
+        "actual: <", record_batch->schema()->ToString(), ">");
+    }
+    condition_.wait(lock, [&] {
+      return closed_ || record_batches_.size() < capacity_;
+    });
+    if (closed_) {
+      return false;
+    }
+    record_batches_.push_back(std::move(record_batch));
+    condition_.notify_all();
+    return true;
+  }
+
+  void
+  RecordBatchQueue::close(arrow::Status status)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+      return;
+    }
+    closed_ = true;
+    status_ = std::move(status);
+    condition_.notify_all();
+  }
+
+  arrow::Result<std::shared_ptr<arrow::Schema>>
+  RecordBatchQueue::wait_schema()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [&] {
+      return closed_ || schema_;
+    });
+    if (schema_) {
+      return schema_;
+    }
+    if (!status_.ok()) {
+      return status_;
+    }
+    return arrow::Status::Invalid(
+      "[arrow-duckdb][record-batch-queue][schema] ",
+      "closed without any record batch");
+  }
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <arrow/api.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace arrow_duckdb {
+  // A record batch reader that reads record batches pushed by other
+  // threads. At most capacity record batches are buffered. Producers
+  // wait in push() until a consumer reads a buffered record batch.
+  //
+  // The schema is the schema of the first pushed record batch when
+  // no schema is specified.
+  class RecordBatchQueue : public arrow::RecordBatchReader {
+  public:
+    RecordBatchQueue(std::shared_ptr<arrow::Schema> schema, size_t capacity);
+
+    std::shared_ptr<arrow::Schema> schema() const override;
+    arrow::Status
+    ReadNext(std::shared_ptr<arrow::RecordBatch> *record_batch) override;
+
+    // Returns false when the queue is already closed.
+    arrow::Result<bool> push(std::shared_ptr<arrow::RecordBatch> record_batch);
+    // ReadNext() returns status after all buffered record batches are
+    // read. The first close() wins.
+    void close(arrow::Status status);
+    // Waits until the schema is available.
+    arrow::Result<std::shared_ptr<arrow::Schema>> wait_schema();
+
+  private:
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    std::shared_ptr<arrow::Schema> schema_;
+    std::deque<std::shared_ptr<arrow::RecordBatch>> record_batches_;
+    size_t capacity_;
+    bool closed_;
+    arrow::Status status_;
+  };
+}
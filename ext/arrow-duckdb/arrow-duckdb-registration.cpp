@@ -15,24 +15,55 @@
  */
 
 #include <arrow-glib/arrow-glib.hpp>
+#include <arrow-dataset-glib/arrow-dataset-glib.hpp>
 
 #include <arrow/c/bridge.h>
+#include <arrow/compute/api.h>
 #include <arrow/dataset/api.h>
+#include <arrow/dataset/file_parquet.h>
+#include <arrow/filesystem/localfs.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 
 #include <rbgobject.h>
 
 #include <duckdb.hpp>
 #ifndef DUCKDB_AMALGAMATION
 #  include <duckdb.h>
+#  include <duckdb/catalog/catalog.hpp>
 #  include <duckdb/common/arrow/arrow_wrapper.hpp>
+#  include <duckdb/execution/expression_executor.hpp>
+#  include <duckdb/function/function_set.hpp>
 #  include <duckdb/function/table/arrow.hpp>
 #  include <duckdb/function/table_function.hpp>
+#  include <duckdb/main/client_context.hpp>
+#  include <duckdb/main/client_context_state.hpp>
+#  include <duckdb/main/config.hpp>
 #  include <duckdb/main/connection.hpp>
+#  include <duckdb/main/database.hpp>
+#  include <duckdb/main/external_dependencies.hpp>
+#  include <duckdb/parallel/task_scheduler.hpp>
+#  include <duckdb/parser/expression/constant_expression.hpp>
+#  include <duckdb/parser/expression/function_expression.hpp>
+#  include <duckdb/parser/parsed_data/create_table_function_info.hpp>
+#  include <duckdb/parser/qualified_name.hpp>
+#  include <duckdb/parser/tableref/table_function_ref.hpp>
 #  include <duckdb/planner/filter/conjunction_filter.hpp>
+#  include <duckdb/planner/expression/bound_conjunction_expression.hpp>
+#  include <duckdb/planner/expression/bound_reference_expression.hpp>
 #  include <duckdb/planner/filter/constant_filter.hpp>
 #  include <duckdb/planner/table_filter.hpp>
+#  include <duckdb/storage/statistics/base_statistics.hpp>
+#  include <duckdb/storage/statistics/node_statistics.hpp>
+#  include <duckdb/storage/statistics/numeric_stats.hpp>
 #endif
 
+#include "arrow-duckdb-gvl.hpp"
+#include "arrow-duckdb-memory-pool.hpp"
+#include "arrow-duckdb-record-batch-queue.hpp"
 #include "arrow-duckdb-registration.hpp"
 
 namespace {
@@ -52,6 +83,35 @@ namespace {
     return *scalar_result;
   }
 
+  std::shared_ptr<arrow::Scalar>
+  convert_constant_decimal(duckdb::Value &value)
+  {
+    auto &type = value.type();
+    auto data_type = arrow::decimal128(duckdb::DecimalType::GetWidth(type),
+                                       duckdb::DecimalType::GetScale(type));
+    switch (type.InternalType()) {
+    case duckdb::PhysicalType::INT16:
+      return std::make_shared<arrow::Decimal128Scalar>(
+        arrow::Decimal128(value.GetValueUnsafe<int16_t>()), data_type);
+    case duckdb::PhysicalType::INT32:
+      return std::make_shared<arrow::Decimal128Scalar>(
+        arrow::Decimal128(value.GetValueUnsafe<int32_t>()), data_type);
+    case duckdb::PhysicalType::INT64:
+      return std::make_shared<arrow::Decimal128Scalar>(
+        arrow::Decimal128(value.GetValueUnsafe<int64_t>()), data_type);
+    case duckdb::PhysicalType::INT128:
+      {
+        auto hugeint = value.GetValueUnsafe<duckdb::hugeint_t>();
+        return std::make_shared<arrow::Decimal128Scalar>(
+          arrow::Decimal128(hugeint.upper, hugeint.lower), data_type);
+      }
+    default:
+      throw duckdb::NotImplementedException(
+        "[arrow][filter][pushdown][%s] not implemented decimal physical type",
+        type.ToString());
+    }
+  }
+
   std::shared_ptr<arrow::Scalar>
   convert_constant(duckdb::Value &value)
   {
@@ -66,12 +126,22 @@ namespace {
       return arrow::MakeScalar(value.GetValue<int32_t>());
     case duckdb::LogicalTypeId::BIGINT:
       return arrow::MakeScalar(value.GetValue<int64_t>());
-    // case duckdb::LogicalTypeId::HUGEINT:
-    //   return arrow::MakeScalar(value.GetValue<duckdb::hugeint_t>());
-    // case duckdb::LogicalTypeId::DATE:
-    //   return arrow::MakeScalar(arrow::date32(), value.GetValue<int32_t>());
-    // case duckdb::LogicalTypeId::TIME:
-    //   return arrow::MakeScalar(arrow::time64(), value.GetValue<int64_t>());
+    case duckdb::LogicalTypeId::HUGEINT:
+      {
+        // Apache Arrow doesn't have 128-bit integer. Apache Arrow
+        // compares decimal128(38, 0) with integers.
+        auto hugeint = value.GetValue<duckdb::hugeint_t>();
+        return std::make_shared<arrow::Decimal128Scalar>(
+          arrow::Decimal128(hugeint.upper, hugeint.lower),
+          arrow::decimal128(38, 0));
+      }
+    case duckdb::LogicalTypeId::DATE:
+      return std::make_shared<arrow::Date32Scalar>(
+        value.GetValue<duckdb::date_t>().days);
+    case duckdb::LogicalTypeId::TIME:
+      return std::make_shared<arrow::Time64Scalar>(
+        value.GetValue<duckdb::dtime_t>().micros,
+        arrow::time64(arrow::TimeUnit::MICRO));
     case duckdb::LogicalTypeId::TIMESTAMP_SEC:
       return convert_constant_timestamp(value, arrow::TimeUnit::SECOND);
     case duckdb::LogicalTypeId::TIMESTAMP_MS:
@@ -94,7 +164,8 @@ namespace {
       return arrow::MakeScalar(value.GetValue<double>());
     case duckdb::LogicalTypeId::VARCHAR:
       return arrow::MakeScalar(value.ToString());
-    // case LogicalTypeId::DECIMAL:
+    case duckdb::LogicalTypeId::DECIMAL:
+      return convert_constant_decimal(value);
     default:
       throw duckdb::NotImplementedException(
         "[arrow][filter][pushdown][%s] not implemented value type",
@@ -102,6 +173,58 @@ namespace {
     }
   }
 
+  // column = v1 OR column = v2 OR ... is converted to is_in(column,
+  // [v1, v2, ...]). is_in() uses a hash table instead of evaluating
+  // all equalities. Returns false when or_filter isn't the form.
+  bool
+  convert_filter_is_in(duckdb::ConjunctionOrFilter *or_filter,
+                       arrow::compute::Expression &field,
+                       arrow::compute::Expression &expression)
+  {
+    if (or_filter->child_filters.size() < 2) {
+      return false;
+    }
+    arrow::ScalarVector values;
+    for (auto &child_filter : or_filter->child_filters) {
+      if (child_filter->filter_type !=
+          duckdb::TableFilterType::CONSTANT_COMPARISON) {
+        return false;
+      }
+      auto constant_filter =
+        static_cast<duckdb::ConstantFilter *>(child_filter.get());
+      if (constant_filter->comparison_type !=
+          duckdb::ExpressionType::COMPARE_EQUAL) {
+        return false;
+      }
+      values.push_back(convert_constant(constant_filter->constant));
+    }
+    auto builder_result = arrow::MakeBuilder(values[0]->type);
+    if (!builder_result.ok()) {
+      return false;
+    }
+    auto builder = std::move(*builder_result);
+    if (!builder->AppendScalars(values).ok()) {
+      return false;
+    }
+    auto value_set_result = builder->Finish();
+    if (!value_set_result.ok()) {
+      return false;
+    }
+    expression = arrow::compute::call(
+      "is_in",
+      {field},
+      arrow::compute::SetLookupOptions(*value_set_result));
+    return true;
+  }
+
+  // DuckDB keeps the original predicate of an optional filter. So we
+  // don't need to evaluate it.
+  bool
+  is_optional_filter(duckdb::TableFilter *filter)
+  {
+    return filter->filter_type == duckdb::TableFilterType::OPTIONAL_FILTER;
+  }
+
   arrow::compute::Expression
   convert_filter(duckdb::TableFilter *filter,
                  std::string &column_name)
@@ -116,6 +239,8 @@ namespace {
         switch (constant_filter->comparison_type) {
         case duckdb::ExpressionType::COMPARE_EQUAL:
           return arrow::compute::equal(field, constant);
+        case duckdb::ExpressionType::COMPARE_NOTEQUAL:
+          return arrow::compute::not_equal(field, constant);
         case duckdb::ExpressionType::COMPARE_LESSTHAN:
           return arrow::compute::less(field, constant);
         case duckdb::ExpressionType::COMPARE_GREATERTHAN:
@@ -138,6 +263,10 @@ namespace {
     case duckdb::TableFilterType::CONJUNCTION_OR:
       {
         auto or_filter = static_cast<duckdb::ConjunctionOrFilter *>(filter);
+        arrow::compute::Expression is_in;
+        if (convert_filter_is_in(or_filter, field, is_in)) {
+          return is_in;
+        }
         std::vector<arrow::compute::Expression> sub_expressions;
         for (auto &child_filter : or_filter->child_filters) {
           sub_expressions.emplace_back(
@@ -150,6 +279,9 @@ namespace {
         auto and_filter = static_cast<duckdb::ConjunctionAndFilter *>(filter);
         std::vector<arrow::compute::Expression> sub_expressions;
         for (auto &child_filter : and_filter->child_filters) {
+          if (is_optional_filter(child_filter.get())) {
+            continue;
+          }
           sub_expressions.emplace_back(
             std::move(convert_filter(child_filter.get(), column_name)));
         }
@@ -162,35 +294,1087 @@ namespace {
     }
   }
 
-  arrow::compute::Expression
+  // Filters are cached by their string representation. Queries
+  // that differ only in a constant use different cache entries.
+  std::string
+  filters_cache_key(duckdb::TableFilterSet *filter_set,
+                    std::unordered_map<idx_t, std::string> &column_names)
+  {
+    std::vector<std::string> filters;
+    for (auto it = filter_set->filters.begin(); it != filter_set->filters.end(); ++it) {
+      filters.push_back(it->second->ToString(column_names[it->first]));
+    }
+    std::sort(filters.begin(), filters.end());
+    std::string key;
+    for (const auto &filter : filters) {
+      key += filter;
+      key += '\0';
+    }
+    return key;
+  }
+
+  // Returns an error when Apache Arrow can't evaluate the filter. For
+  // example, Apache Arrow can't compare a time32 column with a time64
+  // constant but DuckDB uses TIME for both of them.
+  arrow::Result<arrow::compute::Expression>
+  convert_bound_filter(duckdb::TableFilter *filter,
+                       std::string &column_name,
+                       const arrow::Schema &schema)
+  {
+    arrow::compute::Expression expression;
+    try {
+      expression = convert_filter(filter, column_name);
+    } catch (std::exception &error) {
+      return arrow::Status::NotImplemented(error.what());
+    }
+    return expression.Bind(schema);
+  }
+
+  arrow::Result<std::shared_ptr<const arrow_duckdb::ScanFilter>>
   convert_filters(duckdb::TableFilterSet *filter_set,
-                  std::unordered_map<idx_t, std::string> &column_names)
+                  std::unordered_map<idx_t, std::string> &column_names,
+                  arrow_duckdb::Registration &registration)
   {
+    auto key = filters_cache_key(filter_set, column_names);
+    auto cached_filter = registration.lookup_filter(key);
+    if (cached_filter) {
+      return cached_filter;
+    }
+
+    auto scan_filter = std::make_shared<arrow_duckdb::ScanFilter>();
+    const auto &schema = *(registration.schema());
     std::vector<arrow::compute::Expression> expressions;
     for (auto it = filter_set->filters.begin(); it != filter_set->filters.end(); ++it) {
-      expressions.emplace_back(
-        std::move(convert_filter(it->second.get(), column_names[it->first])));
+      auto filter = it->second.get();
+      auto &column_name = column_names[it->first];
+      if (is_optional_filter(filter)) {
+        scan_filter->retained_filters.push_back(filter->ToString(column_name));
+        continue;
+      }
+      // Children of AND are pushed separately. A child that can't be
+      // converted doesn't prevent pushing down the other children.
+      std::vector<duckdb::TableFilter *> sub_filters;
+      if (filter->filter_type == duckdb::TableFilterType::CONJUNCTION_AND) {
+        auto and_filter = static_cast<duckdb::ConjunctionAndFilter *>(filter);
+        for (auto &child_filter : and_filter->child_filters) {
+          if (!is_optional_filter(child_filter.get())) {
+            sub_filters.push_back(child_filter.get());
+          }
+        }
+      } else {
+        sub_filters.push_back(filter);
+      }
+      std::vector<std::string> pushed_sub_filters;
+      for (auto sub_filter : sub_filters) {
+        auto expression_result =
+          convert_bound_filter(sub_filter, column_name, schema);
+        if (!expression_result.ok()) {
+          continue;
+        }
+        expressions.push_back(std::move(*expression_result));
+        pushed_sub_filters.push_back(sub_filter->ToString(column_name));
+      }
+      if (pushed_sub_filters.size() == sub_filters.size()) {
+        scan_filter->pushed_filters.push_back(filter->ToString(column_name));
+        continue;
+      }
+      // DuckDB evaluates the whole filter after the scan.
+      scan_filter->pushed_filters.insert(scan_filter->pushed_filters.end(),
+                                         pushed_sub_filters.begin(),
+                                         pushed_sub_filters.end());
+      scan_filter->retained_filters.push_back(filter->ToString(column_name));
+      scan_filter->retained_columns.push_back(column_name);
+    }
+    ARROW_ASSIGN_OR_RAISE(
+      scan_filter->expression,
+      arrow::compute::and_(expressions).Bind(schema));
+    registration.cache_filter(key, scan_filter);
+    return scan_filter;
+  }
+
+  // Filters on columns of these types are pushed down to the Arrow
+  // scanner. DuckDB evaluates filters on other columns by itself.
+  bool
+  supports_pushdown_type(const duckdb::LogicalType &type)
+  {
+    switch (type.id()) {
+    case duckdb::LogicalTypeId::BOOLEAN:
+    case duckdb::LogicalTypeId::TINYINT:
+    case duckdb::LogicalTypeId::SMALLINT:
+    case duckdb::LogicalTypeId::INTEGER:
+    case duckdb::LogicalTypeId::BIGINT:
+    case duckdb::LogicalTypeId::HUGEINT:
+    case duckdb::LogicalTypeId::DATE:
+    case duckdb::LogicalTypeId::TIME:
+    case duckdb::LogicalTypeId::TIMESTAMP_SEC:
+    case duckdb::LogicalTypeId::TIMESTAMP_MS:
+    case duckdb::LogicalTypeId::TIMESTAMP:
+    case duckdb::LogicalTypeId::TIMESTAMP_NS:
+    case duckdb::LogicalTypeId::UTINYINT:
+    case duckdb::LogicalTypeId::USMALLINT:
+    case duckdb::LogicalTypeId::UINTEGER:
+    case duckdb::LogicalTypeId::UBIGINT:
+    case duckdb::LogicalTypeId::FLOAT:
+    case duckdb::LogicalTypeId::DOUBLE:
+    case duckdb::LogicalTypeId::VARCHAR:
+    case duckdb::LogicalTypeId::DECIMAL:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // Returns a NULL value for unsupported types.
+  duckdb::Value
+  convert_scalar(const arrow::Scalar &scalar)
+  {
+    switch (scalar.type->id()) {
+    case arrow::Type::INT8:
+      return duckdb::Value::TINYINT(
+        static_cast<const arrow::Int8Scalar &>(scalar).value);
+    case arrow::Type::INT16:
+      return duckdb::Value::SMALLINT(
+        static_cast<const arrow::Int16Scalar &>(scalar).value);
+    case arrow::Type::INT32:
+      return duckdb::Value::INTEGER(
+        static_cast<const arrow::Int32Scalar &>(scalar).value);
+    case arrow::Type::INT64:
+      return duckdb::Value::BIGINT(
+        static_cast<const arrow::Int64Scalar &>(scalar).value);
+    case arrow::Type::UINT8:
+      return duckdb::Value::UTINYINT(
+        static_cast<const arrow::UInt8Scalar &>(scalar).value);
+    case arrow::Type::UINT16:
+      return duckdb::Value::USMALLINT(
+        static_cast<const arrow::UInt16Scalar &>(scalar).value);
+    case arrow::Type::UINT32:
+      return duckdb::Value::UINTEGER(
+        static_cast<const arrow::UInt32Scalar &>(scalar).value);
+    case arrow::Type::UINT64:
+      return duckdb::Value::UBIGINT(
+        static_cast<const arrow::UInt64Scalar &>(scalar).value);
+    case arrow::Type::FLOAT:
+      return duckdb::Value::FLOAT(
+        static_cast<const arrow::FloatScalar &>(scalar).value);
+    case arrow::Type::DOUBLE:
+      return duckdb::Value::DOUBLE(
+        static_cast<const arrow::DoubleScalar &>(scalar).value);
+    case arrow::Type::DATE32:
+      return duckdb::Value::DATE(
+        duckdb::date_t(static_cast<const arrow::Date32Scalar &>(scalar).value));
+    default:
+      return duckdb::Value();
+    }
+  }
+
+  duckdb::unique_ptr<duckdb::BaseStatistics>
+  convert_column_statistics(const arrow_duckdb::ColumnStatistics &statistics,
+                            const duckdb::LogicalType &type)
+  {
+    auto has_value = statistics.n_nulls < statistics.n_rows;
+    duckdb::Value min;
+    duckdb::Value max;
+    if (has_value) {
+      if (!statistics.min || !statistics.max) {
+        return nullptr;
+      }
+      min = convert_scalar(*(statistics.min));
+      max = convert_scalar(*(statistics.max));
+      // Wrong statistics cause wrong results. We don't provide
+      // statistics for types that may be converted differently.
+      if (min.IsNull() || max.IsNull() ||
+          min.type() != type || max.type() != type) {
+        return nullptr;
+      }
+    }
+    auto base_statistics = duckdb::NumericStats::CreateEmpty(type);
+    if (statistics.n_nulls > 0) {
+      base_statistics.SetHasNull();
+    }
+    if (has_value) {
+      base_statistics.SetHasNoNull();
+      duckdb::NumericStats::SetMin(base_statistics, min);
+      duckdb::NumericStats::SetMax(base_statistics, max);
+    }
+    return base_statistics.ToUnique();
+  }
+
+  // Per connection state for BindRecorder.
+  class BindRecorderState : public duckdb::ClientContextState {
+  public:
+    static constexpr const char *key = "arrow_duckdb_bind_recorder";
+
+    void
+    record(const arrow_duckdb::Registration *registration)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      registrations_.push_back(registration);
+    }
+
+    void
+    record(const std::string &name)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      names_.push_back(name);
+    }
+
+    std::vector<const arrow_duckdb::Registration *>
+    registrations()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return registrations_;
+    }
+
+    std::vector<std::string>
+    names()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return names_;
+    }
+
+  private:
+    std::mutex mutex_;
+    std::vector<const arrow_duckdb::Registration *> registrations_;
+    std::vector<std::string> names_;
+  };
+
+  duckdb::shared_ptr<BindRecorderState>
+  context_bind_recorder(duckdb::ClientContext &context)
+  {
+    return context.registered_state->Get<BindRecorderState>(
+      BindRecorderState::key);
+  }
+
+  // The memory pool for scans produced in this thread. We can't pass
+  // it to arrow_table_produce() by arguments. ArrowScanInitGlobal()
+  // calls arrow_table_produce() in the same thread.
+  thread_local std::shared_ptr<arrow_duckdb::TrackingMemoryPool>
+    scan_memory_pool;
+  // The number of DuckDB's threads for scans produced in this
+  // thread. This is passed like scan_memory_pool.
+  thread_local int64_t scan_n_threads = 1;
+  // The converted filters of the scan produced in this thread. This
+  // is passed back to init_global() like scan_memory_pool.
+  thread_local std::shared_ptr<const arrow_duckdb::ScanFilter>
+    produced_scan_filter;
+
+  // Counts record batches passed to DuckDB.
+  class CountingRecordBatchReader : public arrow::RecordBatchReader {
+  public:
+    // n_input_rows is -1 when unknown. memory_pool is kept alive
+    // while the scan uses it.
+    CountingRecordBatchReader(
+      std::shared_ptr<arrow::RecordBatchReader> reader,
+      std::shared_ptr<arrow_duckdb::ScanStatistics> statistics,
+      bool filtered,
+      int64_t n_input_rows,
+      std::shared_ptr<arrow::MemoryPool> memory_pool)
+      : reader_(std::move(reader)),
+        statistics_(std::move(statistics)),
+        filtered_(filtered),
+        n_input_rows_(n_input_rows),
+        memory_pool_(std::move(memory_pool))
+    {
+    }
+
+    std::shared_ptr<arrow::Schema>
+    schema() const override
+    {
+      return reader_->schema();
+    }
+
+    arrow::Status
+    ReadNext(std::shared_ptr<arrow::RecordBatch> *record_batch) override
+    {
+      auto start = std::chrono::steady_clock::now();
+      auto status = reader_->ReadNext(record_batch);
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      statistics_->scan_time_ns +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+      ARROW_RETURN_NOT_OK(status);
+      if (*record_batch) {
+        statistics_->n_batches++;
+        statistics_->n_rows += (*record_batch)->num_rows();
+      } else if (!filtered_) {
+        statistics_->n_removed_rows = 0;
+      } else if (n_input_rows_ >= 0) {
+        statistics_->n_removed_rows = n_input_rows_ - statistics_->n_rows;
+      }
+      return arrow::Status::OK();
+    }
+
+  private:
+    std::shared_ptr<arrow::RecordBatchReader> reader_;
+    std::shared_ptr<arrow_duckdb::ScanStatistics> statistics_;
+    bool filtered_;
+    int64_t n_input_rows_;
+    std::shared_ptr<arrow::MemoryPool> memory_pool_;
+  };
+
+  // Splits a registered table or dataset into partitions that are
+  // scanned independently. A table is split into slices of
+  // batch_size rows because an in-memory dataset has only one
+  // fragment per chunk and a table often has only one chunk. A
+  // dataset is split into files and Apache Parquet files are split
+  // into row groups. Files and row groups that never match filter
+  // are skipped here.
+  arrow::Result<arrow::dataset::FragmentVector>
+  list_scan_partitions(const arrow_duckdb::Registration &registration,
+                       const arrow::compute::Expression &filter,
+                       int64_t batch_size)
+  {
+    arrow::dataset::FragmentVector partitions;
+    const auto &table = registration.table();
+    if (table) {
+      for (int64_t offset = 0;
+           offset < table->num_rows();
+           offset += batch_size) {
+        // This is zero-copy.
+        auto slice = table->Slice(offset, batch_size);
+        ARROW_ASSIGN_OR_RAISE(auto record_batches,
+                              arrow::TableBatchReader(*slice).ToRecordBatches());
+        partitions.push_back(
+          std::make_shared<arrow::dataset::InMemoryFragment>(
+            table->schema(), std::move(record_batches)));
+      }
+      return partitions;
+    }
+    ARROW_ASSIGN_OR_RAISE(auto fragment_iterator,
+                          registration.dataset()->GetFragments(filter));
+    ARROW_ASSIGN_OR_RAISE(auto fragments, fragment_iterator.ToVector());
+    for (auto &fragment : fragments) {
+      auto parquet_fragment =
+        std::dynamic_pointer_cast<arrow::dataset::ParquetFileFragment>(
+          fragment);
+      if (parquet_fragment) {
+        ARROW_ASSIGN_OR_RAISE(auto row_groups,
+                              parquet_fragment->SplitByRowGroup(filter));
+        partitions.insert(partitions.end(),
+                          row_groups.begin(),
+                          row_groups.end());
+      } else {
+        partitions.push_back(std::move(fragment));
+      }
+    }
+    return partitions;
+  }
+
+  // Partitions of a scan of a registered table or dataset. Each
+  // DuckDB's scan thread takes the next partition by an atomic
+  // cursor and scans it by its own scanner. So pushed down filters,
+  // projections and conversions to DuckDB's vectors run in parallel
+  // without a shared stream. A record batch reader can't be split.
+  // So it's scanned by arrow_table_produce() instead.
+  class ScanPartitions {
+  public:
+    ScanPartitions(arrow_duckdb::Registration *registration,
+                   arrow::dataset::FragmentVector fragments,
+                   std::shared_ptr<const arrow_duckdb::ScanFilter> scan_filter,
+                   std::vector<std::string> columns,
+                   int64_t batch_size,
+                   std::shared_ptr<arrow_duckdb::ScanStatistics> statistics,
+                   std::shared_ptr<arrow::MemoryPool> memory_pool)
+      : registration_(registration),
+        fragments_(std::move(fragments)),
+        scan_filter_(std::move(scan_filter)),
+        columns_(std::move(columns)),
+        batch_size_(batch_size),
+        statistics_(std::move(statistics)),
+        memory_pool_(std::move(memory_pool)),
+        next_(0)
+    {
+    }
+
+    size_t size() const { return fragments_.size(); }
+
+    // Returns -1 when all partitions are taken.
+    int64_t
+    next()
+    {
+      auto i = next_++;
+      if (i >= fragments_.size()) {
+        return -1;
+      }
+      return static_cast<int64_t>(i);
+    }
+
+    arrow::Result<std::shared_ptr<arrow::RecordBatchReader>>
+    open(int64_t i)
+    {
+      auto options = std::make_shared<arrow::dataset::ScanOptions>();
+      arrow::dataset::ScannerBuilder scanner_builder(registration_->schema(),
+                                                     fragments_[i],
+                                                     std::move(options));
+      // The partition is scanned in the DuckDB's thread that takes
+      // it. Other partitions are scanned by other DuckDB's threads.
+      ARROW_RETURN_NOT_OK(scanner_builder.UseThreads(false));
+      ARROW_RETURN_NOT_OK(scanner_builder.BatchSize(batch_size_));
+      if (memory_pool_) {
+        ARROW_RETURN_NOT_OK(scanner_builder.Pool(memory_pool_.get()));
+      }
+      if (scan_filter_) {
+        ARROW_RETURN_NOT_OK(scanner_builder.Filter(scan_filter_->expression));
+      }
+      if (!columns_.empty()) {
+        ARROW_RETURN_NOT_OK(scanner_builder.Project(columns_));
+      }
+      ARROW_ASSIGN_OR_RAISE(auto scanner, scanner_builder.Finish());
+      ARROW_ASSIGN_OR_RAISE(auto reader, scanner->ToRecordBatchReader());
+      return std::make_shared<CountingRecordBatchReader>(
+        std::move(reader),
+        statistics_,
+        static_cast<bool>(scan_filter_),
+        registration_->n_rows(),
+        memory_pool_);
+    }
+
+  private:
+    arrow_duckdb::Registration *registration_;
+    arrow::dataset::FragmentVector fragments_;
+    std::shared_ptr<const arrow_duckdb::ScanFilter> scan_filter_;
+    std::vector<std::string> columns_;
+    int64_t batch_size_;
+    std::shared_ptr<arrow_duckdb::ScanStatistics> statistics_;
+    std::shared_ptr<arrow::MemoryPool> memory_pool_;
+    std::atomic<size_t> next_;
+  };
+
+  class ScanGlobalState : public duckdb::GlobalTableFunctionState {
+  public:
+    explicit ScanGlobalState(
+      duckdb::unique_ptr<duckdb::GlobalTableFunctionState> arrow_state)
+      : arrow_state(std::move(arrow_state)),
+        filter()
+    {
+    }
+
+    idx_t
+    MaxThreads() const override
+    {
+      return arrow_state->MaxThreads();
+    }
+
+    duckdb::unique_ptr<duckdb::GlobalTableFunctionState> arrow_state;
+    // Filters that Apache Arrow can't evaluate. nullptr when Apache
+    // Arrow evaluates all filters.
+    duckdb::unique_ptr<duckdb::Expression> filter;
+    // nullptr for a record batch reader. arrow_state doesn't have a
+    // stream when this is used.
+    std::unique_ptr<ScanPartitions> partitions;
+  };
+
+  class ScanLocalState : public duckdb::LocalTableFunctionState {
+  public:
+    explicit ScanLocalState(
+      duckdb::unique_ptr<duckdb::LocalTableFunctionState> arrow_state)
+      : arrow_state(std::move(arrow_state)),
+        filter_executor(),
+        selection(STANDARD_VECTOR_SIZE),
+        partition(-1),
+        partition_reader(),
+        n_partition_batches(0)
+    {
+    }
+
+    duckdb::unique_ptr<duckdb::LocalTableFunctionState> arrow_state;
+    // An executor isn't thread-safe. So each scan thread has its own.
+    duckdb::unique_ptr<duckdb::ExpressionExecutor> filter_executor;
+    duckdb::SelectionVector selection;
+    // The partition that this thread scans. -1 when this thread
+    // doesn't have a partition.
+    int64_t partition;
+    std::shared_ptr<arrow::RecordBatchReader> partition_reader;
+    idx_t n_partition_batches;
+  };
+
+  // arrow_scan with supports_pushdown_type, cardinality, statistics
+  // and partitioned scans of tables and datasets. arrow_scan accepts
+  // all filters and drops them. So we evaluate filters that Apache
+  // Arrow can't evaluate by DuckDB's expression executor after
+  // arrow_scan.
+  class ArrowDuckDBScan : public duckdb::ArrowTableFunction {
+  public:
+    static constexpr const char *name = "arrow_duckdb_scan";
+
+    static duckdb::TableFunction
+    create()
+    {
+      duckdb::TableFunction function(name,
+                                     {
+                                       duckdb::LogicalType::POINTER,
+                                       duckdb::LogicalType::POINTER,
+                                       duckdb::LogicalType::POINTER,
+                                     },
+                                     scan,
+                                     bind,
+                                     init_global,
+                                     init_local);
+      function.cardinality = cardinality;
+      function.statistics = statistics;
+      function.get_batch_index = get_batch_index;
+      function.projection_pushdown = true;
+      function.filter_pushdown = true;
+      function.filter_prune = true;
+      function.supports_pushdown_type = supports_pushdown_type;
+      return function;
+    }
+
+  private:
+    // Views are bound here. Bound registrations are recorded for
+    // BindRecorder.
+    static duckdb::unique_ptr<duckdb::FunctionData>
+    bind(duckdb::ClientContext &context,
+         duckdb::TableFunctionBindInput &input,
+         duckdb::vector<duckdb::LogicalType> &return_types,
+         duckdb::vector<std::string> &names)
+    {
+      auto bind_data = ArrowScanBind(context, input, return_types, names);
+      auto bind_recorder = context_bind_recorder(context);
+      if (bind_recorder) {
+        bind_recorder->record(get_registration(bind_data.get()));
+      }
+      return bind_data;
+    }
+
+    // Scans allocate from the memory pool of the query. Tables are
+    // split by the number of threads of the database not the number
+    // of CPUs. It respects "SET threads".
+    static duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
+    init_global(duckdb::ClientContext &context,
+                duckdb::TableFunctionInitInput &input)
+    {
+      // DuckDB's threads wait for the Ruby thread that produces
+      // record batches but it waits for the GVL held by the query.
+      auto registration = get_registration(input.bind_data.get());
+      if (registration->needs_ruby() &&
+          !arrow_duckdb::context_gvl_released(context)) {
+        throw duckdb::InvalidInputException(
+          "[arrow][scan] a registered Enumerable can't be read by a query "
+          "that holds the GVL: use query(..., output: :arrow)");
+      }
+      if (registration->dataset()) {
+        return init_global_partitions(context, input, registration);
+      }
+      scan_memory_pool = arrow_duckdb::context_memory_pool(context);
+      scan_n_threads =
+        duckdb::TaskScheduler::GetScheduler(context).NumberOfThreads();
+      produced_scan_filter.reset();
+      duckdb::unique_ptr<duckdb::GlobalTableFunctionState> arrow_state;
+      try {
+        arrow_state = ArrowScanInitGlobal(context, input);
+      } catch (...) {
+        scan_memory_pool.reset();
+        produced_scan_filter.reset();
+        throw;
+      }
+      scan_memory_pool.reset();
+      auto scan_filter = std::move(produced_scan_filter);
+      produced_scan_filter.reset();
+      auto state = duckdb::make_uniq<ScanGlobalState>(std::move(arrow_state));
+      state->filter = retained_filter(input, scan_filter.get());
+      return std::move(state);
+    }
+
+    // This doesn't use ArrowScanInitGlobal() because it produces one
+    // stream shared by all threads. Projection IDs and scanned types
+    // are the same as ArrowScanInitGlobal().
+    static duckdb::unique_ptr<duckdb::GlobalTableFunctionState>
+    init_global_partitions(duckdb::ClientContext &context,
+                           duckdb::TableFunctionInitInput &input,
+                           arrow_duckdb::Registration *registration)
+    {
+      auto &data = input.bind_data->Cast<duckdb::ArrowScanFunctionData>();
+      const auto &schema = registration->schema();
+      auto arrow_state = duckdb::make_uniq<duckdb::ArrowScanGlobalState>();
+      // Keys are the index in input.column_ids like
+      // ArrowStreamParameters::projected_columns::projection_map.
+      std::unordered_map<idx_t, std::string> column_names;
+      std::vector<std::string> columns;
+      for (idx_t i = 0; i < input.column_ids.size(); ++i) {
+        auto column_index = input.column_ids[i];
+        if (column_index == duckdb::COLUMN_IDENTIFIER_ROW_ID) {
+          continue;
+        }
+        const auto &column_name = schema->field(column_index)->name();
+        column_names[i] = column_name;
+        columns.push_back(column_name);
+      }
+      if (!input.projection_ids.empty()) {
+        arrow_state->projection_ids = input.projection_ids;
+        for (auto column_index : input.column_ids) {
+          if (column_index == duckdb::COLUMN_IDENTIFIER_ROW_ID) {
+            arrow_state->scanned_types.push_back(duckdb::LogicalType::ROW_TYPE);
+          } else {
+            arrow_state->scanned_types.push_back(data.all_types[column_index]);
+          }
+        }
+      }
+      auto statistics = registration->start_scan();
+      std::shared_ptr<const arrow_duckdb::ScanFilter> scan_filter;
+      auto filter = arrow::compute::literal(true);
+      if (input.filters && !input.filters->filters.empty()) {
+        auto scan_filter_result =
+          convert_filters(input.filters.get(), column_names, *registration);
+        if (!scan_filter_result.ok()) {
+          throw duckdb::InvalidInputException(
+            "[arrow][scan] failed to convert filters: %s",
+            scan_filter_result.status().ToString());
+        }
+        scan_filter = *scan_filter_result;
+        statistics->pushed_filters = scan_filter->pushed_filters;
+        statistics->retained_filters = scan_filter->retained_filters;
+        filter = scan_filter->expression;
+      }
+      int64_t n_threads =
+        duckdb::TaskScheduler::GetScheduler(context).NumberOfThreads();
+      auto batch_size = registration->batch_size(n_threads);
+      auto fragments_result =
+        list_scan_partitions(*registration, filter, batch_size);
+      if (!fragments_result.ok()) {
+        throw duckdb::IOException(
+          "[arrow][scan] failed to split into partitions: %s",
+          fragments_result.status().ToString());
+      }
+      auto n_partitions = static_cast<int64_t>(fragments_result->size());
+      // No reader reaches the end when filters skip all partitions.
+      if (n_partitions == 0 && registration->n_rows() >= 0) {
+        statistics->n_removed_rows = scan_filter ? registration->n_rows() : 0;
+      }
+      arrow_state->max_threads =
+        std::max(static_cast<int64_t>(1), std::min(n_partitions, n_threads));
+      auto state = duckdb::make_uniq<ScanGlobalState>(std::move(arrow_state));
+      state->filter = retained_filter(input, scan_filter.get());
+      state->partitions = std::make_unique<ScanPartitions>(
+        registration,
+        std::move(*fragments_result),
+        std::move(scan_filter),
+        std::move(columns),
+        batch_size,
+        std::move(statistics),
+        arrow_duckdb::context_memory_pool(context));
+      return std::move(state);
+    }
+
+    // Builds a DuckDB expression of the filters that Apache Arrow
+    // can't evaluate. Columns are referred by the index in
+    // input.column_ids. It's the index in the scanned chunk too.
+    static duckdb::unique_ptr<duckdb::Expression>
+    retained_filter(duckdb::TableFunctionInitInput &input,
+                    const arrow_duckdb::ScanFilter *scan_filter)
+    {
+      if (!scan_filter || scan_filter->retained_columns.empty() ||
+          !input.filters) {
+        return nullptr;
+      }
+      auto &data = input.bind_data->Cast<duckdb::ArrowScanFunctionData>();
+      auto schema = get_registration(input.bind_data.get())->schema();
+      const auto &retained_columns = scan_filter->retained_columns;
+      duckdb::vector<duckdb::unique_ptr<duckdb::Expression>> expressions;
+      for (auto &it : input.filters->filters) {
+        auto column_index = input.column_ids[it.first];
+        const auto &column_name = schema->field(column_index)->name();
+        if (std::find(retained_columns.begin(),
+                      retained_columns.end(),
+                      column_name) == retained_columns.end()) {
+          continue;
+        }
+        duckdb::BoundReferenceExpression column(data.all_types[column_index],
+                                                it.first);
+        expressions.push_back(it.second->ToExpression(column));
+      }
+      if (expressions.empty()) {
+        return nullptr;
+      }
+      if (expressions.size() == 1) {
+        return std::move(expressions[0]);
+      }
+      auto conjunction = duckdb::make_uniq<duckdb::BoundConjunctionExpression>(
+        duckdb::ExpressionType::CONJUNCTION_AND);
+      conjunction->children = std::move(expressions);
+      return std::move(conjunction);
+    }
+
+    static duckdb::unique_ptr<duckdb::LocalTableFunctionState>
+    init_local(duckdb::ExecutionContext &context,
+               duckdb::TableFunctionInitInput &input,
+               duckdb::GlobalTableFunctionState *global_state)
+    {
+      auto &state = global_state->Cast<ScanGlobalState>();
+      duckdb::unique_ptr<duckdb::LocalTableFunctionState> arrow_local_state;
+      if (state.partitions) {
+        arrow_local_state = init_local_partitions(context, input, state);
+      } else {
+        arrow_local_state =
+          ArrowScanInitLocal(context, input, state.arrow_state.get());
+      }
+      auto local_state =
+        duckdb::make_uniq<ScanLocalState>(std::move(arrow_local_state));
+      if (state.filter) {
+        local_state->filter_executor =
+          duckdb::make_uniq<duckdb::ExpressionExecutor>(context.client,
+                                                        *(state.filter));
+      }
+      return std::move(local_state);
+    }
+
+    // This is the same as ArrowScanInitLocal() but this doesn't read
+    // the first chunk. scan() reads it from the partition that this
+    // thread takes.
+    static duckdb::unique_ptr<duckdb::LocalTableFunctionState>
+    init_local_partitions(duckdb::ExecutionContext &context,
+                          duckdb::TableFunctionInitInput &input,
+                          ScanGlobalState &state)
+    {
+      auto &arrow_state =
+        state.arrow_state->Cast<duckdb::ArrowScanGlobalState>();
+      auto chunk = duckdb::make_shared_ptr<duckdb::ArrowArrayWrapper>();
+      auto arrow_local_state =
+        duckdb::make_uniq<duckdb::ArrowScanLocalState>(std::move(chunk),
+                                                       context.client);
+      arrow_local_state->column_ids = input.column_ids;
+      arrow_local_state->filters = input.filters.get();
+      if (arrow_state.CanRemoveFilterColumns()) {
+        arrow_local_state->all_columns.Initialize(context.client,
+                                                  arrow_state.scanned_types);
+      }
+      return std::move(arrow_local_state);
+    }
+
+    // An empty output means the end of the scan. So we read the next
+    // chunk when the retained filters remove all rows.
+    static void
+    scan(duckdb::ClientContext &context,
+         duckdb::TableFunctionInput &input,
+         duckdb::DataChunk &output)
+    {
+      auto &global_state = input.global_state->Cast<ScanGlobalState>();
+      auto &local_state = input.local_state->Cast<ScanLocalState>();
+      duckdb::TableFunctionInput arrow_input(input.bind_data,
+                                             local_state.arrow_state.get(),
+                                             global_state.arrow_state.get());
+      if (!local_state.filter_executor) {
+        scan_chunk(context, arrow_input, global_state, local_state, output);
+        return;
+      }
+      auto &arrow_global_state =
+        global_state.arrow_state->Cast<duckdb::ArrowScanGlobalState>();
+      auto &arrow_local_state =
+        local_state.arrow_state->Cast<duckdb::ArrowScanLocalState>();
+      while (true) {
+        scan_chunk(context, arrow_input, global_state, local_state, output);
+        auto n_rows = output.size();
+        if (n_rows == 0) {
+          return;
+        }
+        // Filter only columns are scanned into all_columns when
+        // DuckDB doesn't need them in output.
+        auto &scanned = arrow_global_state.CanRemoveFilterColumns() ?
+          arrow_local_state.all_columns :
+          output;
+        auto n_selected =
+          local_state.filter_executor->SelectExpression(scanned,
+                                                        local_state.selection);
+        if (n_selected == n_rows) {
+          return;
+        }
+        if (n_selected > 0) {
+          output.Slice(local_state.selection, n_selected);
+          return;
+        }
+        output.Reset();
+      }
+    }
+
+    // The conversion is the same as ArrowScanFunction() but the
+    // chunk is read from the partition of this thread instead of the
+    // shared stream.
+    static void
+    scan_chunk(duckdb::ClientContext &context,
+               duckdb::TableFunctionInput &arrow_input,
+               ScanGlobalState &global_state,
+               ScanLocalState &local_state,
+               duckdb::DataChunk &output)
+    {
+      if (!global_state.partitions) {
+        ArrowScanFunction(context, arrow_input, output);
+        return;
+      }
+      auto &data =
+        arrow_input.bind_data->CastNoConst<duckdb::ArrowScanFunctionData>();
+      auto &arrow_global_state =
+        global_state.arrow_state->Cast<duckdb::ArrowScanGlobalState>();
+      auto &arrow_local_state =
+        local_state.arrow_state->Cast<duckdb::ArrowScanLocalState>();
+      auto n_chunk_rows =
+        static_cast<idx_t>(arrow_local_state.chunk->arrow_array.length);
+      if (arrow_local_state.chunk_offset >= n_chunk_rows) {
+        if (!read_partition_chunk(global_state, local_state)) {
+          return;
+        }
+        n_chunk_rows =
+          static_cast<idx_t>(arrow_local_state.chunk->arrow_array.length);
+      }
+      auto output_size =
+        std::min(static_cast<idx_t>(STANDARD_VECTOR_SIZE),
+                 n_chunk_rows - arrow_local_state.chunk_offset);
+      data.lines_read += output_size;
+      if (arrow_global_state.CanRemoveFilterColumns()) {
+        arrow_local_state.all_columns.Reset();
+        arrow_local_state.all_columns.SetCardinality(output_size);
+        ArrowToDuckDB(arrow_local_state,
+                      data.arrow_table.GetColumns(),
+                      arrow_local_state.all_columns,
+                      data.lines_read - output_size);
+        output.ReferenceColumns(arrow_local_state.all_columns,
+                                arrow_global_state.projection_ids);
+      } else {
+        output.SetCardinality(output_size);
+        ArrowToDuckDB(arrow_local_state,
+                      data.arrow_table.GetColumns(),
+                      output,
+                      data.lines_read - output_size);
+      }
+      output.Verify();
+      arrow_local_state.chunk_offset += output.size();
+    }
+
+    // Reads the next record batch of the partition of this thread.
+    // This takes the next partition when the partition is
+    // finished. Returns false when all partitions are finished.
+    static bool
+    read_partition_chunk(ScanGlobalState &global_state,
+                         ScanLocalState &local_state)
+    {
+      // DuckDB requires batch indexes that follow the order of the
+      // data to preserve insertion order. A partition has less than
+      // this number of record batches.
+      const idx_t max_n_partition_batches = static_cast<idx_t>(1) << 20;
+      auto &arrow_local_state =
+        local_state.arrow_state->Cast<duckdb::ArrowScanLocalState>();
+      while (true) {
+        if (!local_state.partition_reader) {
+          local_state.partition = global_state.partitions->next();
+          if (local_state.partition < 0) {
+            return false;
+          }
+          auto reader_result =
+            global_state.partitions->open(local_state.partition);
+          if (!reader_result.ok()) {
+            throw duckdb::IOException(
+              "[arrow][scan] failed to open partition: %s",
+              reader_result.status().ToString());
+          }
+          local_state.partition_reader = std::move(*reader_result);
+          local_state.n_partition_batches = 0;
+        }
+        std::shared_ptr<arrow::RecordBatch> record_batch;
+        auto status = local_state.partition_reader->ReadNext(&record_batch);
+        if (!status.ok()) {
+          throw duckdb::IOException("[arrow][scan] failed to read: %s",
+                                    status.ToString());
+        }
+        if (!record_batch) {
+          local_state.partition_reader.reset();
+          continue;
+        }
+        if (record_batch->num_rows() == 0) {
+          continue;
+        }
+        auto chunk = duckdb::make_shared_ptr<duckdb::ArrowArrayWrapper>();
+        status = arrow::ExportRecordBatch(*record_batch, &(chunk->arrow_array));
+        if (!status.ok()) {
+          throw duckdb::IOException("[arrow][scan] failed to export: %s",
+                                    status.ToString());
+        }
+        arrow_local_state.Reset();
+        arrow_local_state.chunk = std::move(chunk);
+        arrow_local_state.batch_index =
+          static_cast<idx_t>(local_state.partition) * max_n_partition_batches +
+          local_state.n_partition_batches;
+        local_state.n_partition_batches++;
+        return true;
+      }
+    }
+
+    static idx_t
+    get_batch_index(duckdb::ClientContext &context,
+                    const duckdb::FunctionData *bind_data,
+                    duckdb::LocalTableFunctionState *local_state,
+                    duckdb::GlobalTableFunctionState *global_state)
+    {
+      return ArrowGetBatchIndex(
+        context,
+        bind_data,
+        local_state->Cast<ScanLocalState>().arrow_state.get(),
+        global_state->Cast<ScanGlobalState>().arrow_state.get());
+    }
+
+    static arrow_duckdb::Registration *
+    get_registration(const duckdb::FunctionData *bind_data)
+    {
+      auto &data = bind_data->Cast<duckdb::ArrowScanFunctionData>();
+      return reinterpret_cast<arrow_duckdb::Registration *>(
+        data.stream_factory_ptr);
+    }
+
+    // The optimizer uses this to choose join order and build side of
+    // hash joins.
+    static duckdb::unique_ptr<duckdb::NodeStatistics>
+    cardinality(duckdb::ClientContext &context,
+                const duckdb::FunctionData *bind_data)
+    {
+      auto n_rows = get_registration(bind_data)->n_rows();
+      if (n_rows < 0) {
+        return duckdb::make_uniq<duckdb::NodeStatistics>();
+      }
+      return duckdb::make_uniq<duckdb::NodeStatistics>(n_rows, n_rows);
+    }
+
+    // The optimizer uses this to prune filters that never match.
+    static duckdb::unique_ptr<duckdb::BaseStatistics>
+    statistics(duckdb::ClientContext &context,
+               const duckdb::FunctionData *bind_data,
+               duckdb::column_t column_index)
+    {
+      auto &data = bind_data->Cast<duckdb::ArrowScanFunctionData>();
+      if (column_index >= data.all_types.size()) {
+        return nullptr;
+      }
+      auto column_statistics =
+        get_registration(bind_data)->column_statistics(column_index);
+      if (!column_statistics) {
+        return nullptr;
+      }
+      return convert_column_statistics(*column_statistics,
+                                       data.all_types[column_index]);
+    }
+  };
+
+  void
+  register_scan_function(duckdb::Connection &connection)
+  {
+    auto &db = duckdb::DatabaseInstance::GetDatabase(*(connection.context));
+    duckdb::TableFunctionSet function_set(ArrowDuckDBScan::name);
+    function_set.AddFunction(ArrowDuckDBScan::create());
+    duckdb::CreateTableFunctionInfo info(std::move(function_set));
+    info.on_conflict = duckdb::OnCreateConflict::IGNORE_ON_CONFLICT;
+    auto &catalog = duckdb::Catalog::GetSystemCatalog(db);
+    auto transaction = duckdb::CatalogTransaction::GetSystemTransaction(db);
+    catalog.CreateFunction(transaction, info);
+  }
+
+  // A table is split into partitions of this size. Each thread
+  // should have some partitions to balance load. Each partition
+  // should be large enough to amortize per partition scanner setup
+  // and be a multiple of DuckDB's vector size.
+  int64_t
+  compute_scan_batch_size(int64_t n_rows, int64_t n_threads)
+  {
+    const int64_t vector_size = STANDARD_VECTOR_SIZE;
+    const int64_t max_batch_size = arrow::dataset::kDefaultBatchSize;
+    const int64_t n_batches_per_thread = 4;
+    n_threads = std::max(static_cast<int64_t>(1), n_threads);
+    auto batch_size = n_rows / (n_threads * n_batches_per_thread);
+    batch_size = ((batch_size + vector_size - 1) / vector_size) * vector_size;
+    return std::min(std::max(batch_size, vector_size), max_batch_size);
+  }
+
+  // MinMax() skips NaN but DuckDB sorts NaN after all other values.
+  // "WHERE a > 3" matches NaN. So min/max without NaN prune filters
+  // that match.
+  arrow::Result<bool>
+  has_nan(const std::shared_ptr<arrow::ChunkedArray> &column)
+  {
+    if (!arrow::is_floating(column->type()->id())) {
+      return false;
+    }
+    ARROW_ASSIGN_OR_RAISE(auto is_nan, arrow::compute::IsNan(column));
+    ARROW_ASSIGN_OR_RAISE(auto any, arrow::compute::Any(is_nan));
+    const auto &scalar = any.scalar_as<arrow::BooleanScalar>();
+    return scalar.is_valid && scalar.value;
+  }
+
+  std::shared_ptr<arrow_duckdb::ColumnStatistics>
+  compute_column_statistics(const std::shared_ptr<arrow::ChunkedArray> &column)
+  {
+    auto statistics = std::make_shared<arrow_duckdb::ColumnStatistics>();
+    statistics->n_rows = column->length();
+    statistics->n_nulls = column->null_count();
+    if (statistics->n_nulls == statistics->n_rows) {
+      return statistics;
+    }
+    // No min/max means no statistics for the column.
+    auto has_nan_result = has_nan(column);
+    if (!has_nan_result.ok() || *has_nan_result) {
+      return statistics;
+    }
+    auto min_max_result = arrow::compute::MinMax(column);
+    if (!min_max_result.ok()) {
+      return nullptr;
     }
-    return arrow::compute::and_(expressions);
+    const auto &min_max = min_max_result->scalar_as<arrow::StructScalar>();
+    statistics->min = min_max.value[0];
+    statistics->max = min_max.value[1];
+    return statistics;
+  }
+
+  // A record batch reader can't be rewound. So we can scan it only
+  // once. The second scan such as the second query or a self join
+  // is an error instead of an empty result.
+  arrow::Status
+  record_batch_reader_start_scan(GArrowRecordBatchReader *reader)
+  {
+    static std::mutex mutex;
+    static const char *key = "arrow-duckdb-scanned";
+    std::lock_guard<std::mutex> lock(mutex);
+    if (g_object_get_data(G_OBJECT(reader), key)) {
+      return arrow::Status::Invalid(
+        "[arrow-duckdb][scan] record batch reader can be scanned only once");
+    }
+    g_object_set_data(G_OBJECT(reader), key, GINT_TO_POINTER(TRUE));
+    return arrow::Status::OK();
   }
 
   arrow::Result<std::unique_ptr<duckdb::ArrowArrayStreamWrapper>>
   arrow_table_produce_internal(uintptr_t data,
                                duckdb::ArrowStreamParameters &parameters)
   {
-    auto garrow_table = GARROW_TABLE(reinterpret_cast<gpointer>(data));
-    auto arrow_table = garrow_table_get_raw(garrow_table);
-    auto dataset =
-      std::make_shared<arrow::dataset::InMemoryDataset>(arrow_table);
-    ARROW_ASSIGN_OR_RAISE(auto scanner_builder, dataset->NewScan());
+    auto registration = reinterpret_cast<arrow_duckdb::Registration *>(data);
+    // Tables and datasets are scanned by ScanPartitions. Only a record
+    // batch reader is scanned here.
+    auto reader = GARROW_RECORD_BATCH_READER(registration->source());
+    ARROW_RETURN_NOT_OK(record_batch_reader_start_scan(reader));
+    // Record batches are passed through as they arrive. We don't
+    // buffer the whole stream.
+    auto scanner_builder =
+      arrow::dataset::ScannerBuilder::FromRecordBatchReader(
+        garrow_record_batch_reader_get_raw(reader));
+    // Pushed down filters and projections are evaluated in Apache
+    // Arrow's thread pool. The result is one stream shared by
+    // DuckDB's scan threads because a stream can't be split.
+    ARROW_RETURN_NOT_OK(scanner_builder->UseThreads(true));
+    ARROW_RETURN_NOT_OK(
+      scanner_builder->BatchSize(registration->batch_size(scan_n_threads)));
+    // Allocations for pushed down filters and projections are counted
+    // by the pool of the query.
+    auto memory_pool = scan_memory_pool;
+    if (memory_pool) {
+      ARROW_RETURN_NOT_OK(scanner_builder->Pool(memory_pool.get()));
+    }
     bool have_filter =
       parameters.filters &&
       !parameters.filters->filters.empty();
+    auto statistics = registration->start_scan();
     if (have_filter) {
-      ARROW_RETURN_NOT_OK(
-        scanner_builder->Filter(
-          convert_filters(parameters.filters,
-                          parameters.projected_columns.projection_map)));
+      ARROW_ASSIGN_OR_RAISE(
+        auto scan_filter,
+        convert_filters(parameters.filters,
+                        parameters.projected_columns.projection_map,
+                        *registration));
+      statistics->pushed_filters = scan_filter->pushed_filters;
+      statistics->retained_filters = scan_filter->retained_filters;
+      ARROW_RETURN_NOT_OK(scanner_builder->Filter(scan_filter->expression));
+      produced_scan_filter = scan_filter;
     }
     if (!parameters.projected_columns.columns.empty()) {
       ARROW_RETURN_NOT_OK(
@@ -198,7 +1382,13 @@ namespace {
           parameters.projected_columns.columns));
     }
     ARROW_ASSIGN_OR_RAISE(auto scanner, scanner_builder->Finish());
-    ARROW_ASSIGN_OR_RAISE(auto reader, scanner->ToRecordBatchReader());
+    ARROW_ASSIGN_OR_RAISE(auto scanner_reader, scanner->ToRecordBatchReader());
+    auto reader = std::make_shared<CountingRecordBatchReader>(
+      std::move(scanner_reader),
+      std::move(statistics),
+      have_filter,
+      registration->n_rows(),
+      std::move(memory_pool));
     auto stream_wrapper = duckdb::make_uniq<duckdb::ArrowArrayStreamWrapper>();
     ARROW_RETURN_NOT_OK(
       arrow::ExportRecordBatchReader(reader,
@@ -222,9 +1412,8 @@ namespace {
   void
   arrow_table_get_schema(uintptr_t data, duckdb::ArrowSchemaWrapper &schema)
   {
-    auto garrow_table = GARROW_TABLE(reinterpret_cast<gpointer>(data));
-    auto arrow_table = garrow_table_get_raw(garrow_table);
-    auto export_schema_status = arrow::ExportSchema(*(arrow_table->schema()),
+    auto registration = reinterpret_cast<arrow_duckdb::Registration *>(data);
+    auto export_schema_status = arrow::ExportSchema(*(registration->schema()),
                                                     reinterpret_cast<ArrowSchema *>(&schema));
     if (!export_schema_status.ok()) {
       throw std::runtime_error(
@@ -234,7 +1423,365 @@ namespace {
   }
 }
 
+namespace {
+  // Keeps a registration alive while a bound query refers it.
+  class RegistrationDependency : public duckdb::DependencyItem {
+  public:
+    explicit RegistrationDependency(
+      std::shared_ptr<arrow_duckdb::Registration> registration)
+      : registration_(std::move(registration))
+    {
+    }
+
+  private:
+    std::shared_ptr<arrow_duckdb::Registration> registration_;
+  };
+
+  // Per connection state for replacement scans.
+  class SourceResolverState : public duckdb::ClientContextState {
+  public:
+    static constexpr const char *key = "arrow_duckdb_source_resolver";
+    // Resolved registrations are cached for the next queries but
+    // many short-lived names must not grow the cache infinitely.
+    static constexpr size_t max_n_registrations = 64;
+
+    explicit SourceResolverState(arrow_duckdb::SourceResolver resolver)
+      : resolver_(std::move(resolver)),
+        mutex_(),
+        registrations_()
+    {
+    }
+
+    // nullptr for an unknown name. This throws an exception on error.
+    std::shared_ptr<arrow_duckdb::Registration>
+    resolve(const std::string &name)
+    {
+      auto source_result = resolver_(name);
+      if (!source_result.ok()) {
+        throw duckdb::BinderException(
+          "[arrow][replacement-scan][%s] failed to resolve: %s",
+          name,
+          source_result.status().ToString());
+      }
+      auto source = *source_result;
+      if (!source) {
+        return nullptr;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = registrations_.find(name);
+      if (it != registrations_.end() && it->second->source() == source) {
+        g_object_unref(source);
+        return it->second;
+      }
+      // Running queries keep their registrations by dependencies.
+      if (registrations_.size() >= max_n_registrations) {
+        registrations_.clear();
+      }
+      auto registration =
+        std::make_shared<arrow_duckdb::Registration>(source, false);
+      g_object_unref(source);
+      registrations_[name] = registration;
+      return registration;
+    }
+
+  private:
+    arrow_duckdb::SourceResolver resolver_;
+    std::mutex mutex_;
+    std::unordered_map<std::string,
+                       std::shared_ptr<arrow_duckdb::Registration>>
+      registrations_;
+  };
+
+  // Per connection state for registrations shared with other
+  // connections.
+  class SharedRegistrationsState : public duckdb::ClientContextState {
+  public:
+    static constexpr const char *key = "arrow_duckdb_shared_registrations";
+
+    explicit SharedRegistrationsState(
+      std::shared_ptr<arrow_duckdb::SharedRegistrations> registrations)
+      : registrations_(std::move(registrations))
+    {
+    }
+
+    std::shared_ptr<arrow_duckdb::Registration>
+    resolve(const std::string &name)
+    {
+      return registrations_->lookup(name);
+    }
+
+  private:
+    std::shared_ptr<arrow_duckdb::SharedRegistrations> registrations_;
+  };
+
+  // Shared registrations are used before the source resolver.
+  std::shared_ptr<arrow_duckdb::Registration>
+  resolve_registration(duckdb::ClientContext &context, const std::string &name)
+  {
+    auto shared_registrations_state =
+      context.registered_state->Get<SharedRegistrationsState>(
+        SharedRegistrationsState::key);
+    if (shared_registrations_state) {
+      auto registration = shared_registrations_state->resolve(name);
+      if (registration) {
+        return registration;
+      }
+    }
+    auto source_resolver_state =
+      context.registered_state->Get<SourceResolverState>(
+        SourceResolverState::key);
+    if (source_resolver_state) {
+      return source_resolver_state->resolve(name);
+    }
+    return nullptr;
+  }
+
+  duckdb::unique_ptr<duckdb::TableRef>
+  arrow_replacement_scan(
+    duckdb::ClientContext &context,
+    duckdb::ReplacementScanInput &input,
+    duckdb::optional_ptr<duckdb::ReplacementScanData> data)
+  {
+    auto registration = resolve_registration(context, input.table_name);
+    if (!registration) {
+      return nullptr;
+    }
+    auto bind_recorder = context_bind_recorder(context);
+    if (bind_recorder) {
+      bind_recorder->record(input.table_name);
+    }
+
+    duckdb::vector<duckdb::unique_ptr<duckdb::ParsedExpression>> children;
+    children.push_back(
+      duckdb::make_uniq<duckdb::ConstantExpression>(
+        duckdb::Value::POINTER(reinterpret_cast<uintptr_t>(registration.get()))));
+    children.push_back(
+      duckdb::make_uniq<duckdb::ConstantExpression>(
+        duckdb::Value::POINTER(reinterpret_cast<uintptr_t>(arrow_table_produce))));
+    children.push_back(
+      duckdb::make_uniq<duckdb::ConstantExpression>(
+        duckdb::Value::POINTER(reinterpret_cast<uintptr_t>(arrow_table_get_schema))));
+    auto table_function = duckdb::make_uniq<duckdb::TableFunctionRef>();
+    table_function->function =
+      duckdb::make_uniq<duckdb::FunctionExpression>(ArrowDuckDBScan::name,
+                                                    std::move(children));
+    table_function->alias = input.table_name;
+    auto dependency = duckdb::make_shared_ptr<duckdb::ExternalDependency>();
+    dependency->AddDependency(
+      "registration",
+      duckdb::make_shared_ptr<RegistrationDependency>(std::move(registration)));
+    table_function->external_dependency = std::move(dependency);
+    return std::move(table_function);
+  }
+
+  void
+  register_replacement_scan(duckdb::DatabaseInstance &db)
+  {
+    auto &config = duckdb::DBConfig::GetConfig(db);
+    for (const auto &replacement_scan : config.replacement_scans) {
+      if (replacement_scan.function == arrow_replacement_scan) {
+        return;
+      }
+    }
+    config.replacement_scans.emplace_back(arrow_replacement_scan);
+  }
+
+  // Registers the scan function and the replacement scan once per
+  // database. DuckDB doesn't guard DBConfig::replacement_scans. We
+  // serialize our modifications by mutex and modify it only at the
+  // first registration of the database.
+  void
+  initialize_database(duckdb::Connection &connection)
+  {
+    static std::mutex mutex;
+    static std::vector<duckdb::weak_ptr<duckdb::DatabaseInstance>>
+      initialized_databases;
+    auto &db = duckdb::DatabaseInstance::GetDatabase(*(connection.context));
+    std::lock_guard<std::mutex> lock(mutex);
+    initialized_databases.erase(
+      std::remove_if(initialized_databases.begin(),
+                     initialized_databases.end(),
+                     [](const duckdb::weak_ptr<duckdb::DatabaseInstance> &database) {
+                       return database.expired();
+                     }),
+      initialized_databases.end());
+    for (const auto &database : initialized_databases) {
+      if (database.lock().get() == &db) {
+        return;
+      }
+    }
+    register_scan_function(connection);
+    register_replacement_scan(db);
+    initialized_databases.emplace_back(db.shared_from_this());
+  }
+}
+
 namespace arrow_duckdb {
+  Registration::Registration(GObject *source, bool compute_statistics)
+    : source_(G_OBJECT(g_object_ref(source))),
+      schema_(),
+      dataset_(),
+      table_(),
+      n_rows_(-1),
+      needs_ruby_(false),
+      column_statistics_(),
+      mutex_(),
+      last_scan_statistics_(),
+      filters_()
+  {
+    if (GARROW_IS_TABLE(source_)) {
+      auto arrow_table = garrow_table_get_raw(GARROW_TABLE(source_));
+      schema_ = arrow_table->schema();
+      dataset_ = std::make_shared<arrow::dataset::InMemoryDataset>(arrow_table);
+      table_ = arrow_table;
+      n_rows_ = arrow_table->num_rows();
+      if (compute_statistics) {
+        for (const auto &column : arrow_table->columns()) {
+          column_statistics_.push_back(compute_column_statistics(column));
+        }
+      }
+    } else if (GARROW_IS_RECORD_BATCH_READER(source_)) {
+      auto reader = GARROW_RECORD_BATCH_READER(source_);
+      auto raw_reader = garrow_record_batch_reader_get_raw(reader);
+      schema_ = raw_reader->schema();
+      needs_ruby_ = static_cast<bool>(
+        std::dynamic_pointer_cast<RecordBatchQueue>(raw_reader));
+    } else {
+      dataset_ = gadataset_dataset_get_raw(GADATASET_DATASET(source_));
+      schema_ = dataset_->schema();
+      if (compute_statistics) {
+        // This uses metadata such as Apache Parquet's row counts
+        // when possible.
+        auto scanner_builder_result = dataset_->NewScan();
+        if (scanner_builder_result.ok()) {
+          auto scanner_result = (*scanner_builder_result)->Finish();
+          if (scanner_result.ok()) {
+            auto n_rows_result = (*scanner_result)->CountRows();
+            if (n_rows_result.ok()) {
+              n_rows_ = *n_rows_result;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  int64_t
+  Registration::batch_size(int64_t n_threads) const
+  {
+    if (GARROW_IS_TABLE(source_)) {
+      return compute_scan_batch_size(n_rows_, n_threads);
+    } else {
+      return arrow::dataset::kDefaultBatchSize;
+    }
+  }
+
+  Registration::~Registration()
+  {
+    g_object_unref(source_);
+  }
+
+  std::shared_ptr<ScanStatistics>
+  Registration::start_scan()
+  {
+    auto statistics = std::make_shared<ScanStatistics>();
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_scan_statistics_ = statistics;
+    return statistics;
+  }
+
+  std::shared_ptr<ScanStatistics>
+  Registration::last_scan_statistics()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_scan_statistics_;
+  }
+
+  std::shared_ptr<const ScanFilter>
+  Registration::lookup_filter(const std::string &key)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = filters_.find(key);
+    if (it == filters_.end()) {
+      return nullptr;
+    }
+    return it->second;
+  }
+
+  void
+  Registration::cache_filter(const std::string &key,
+                             std::shared_ptr<const ScanFilter> filter)
+  {
+    // Queries with many different constants must not grow the cache
+    // unlimitedly.
+    const size_t max_n_filters = 64;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (filters_.size() >= max_n_filters) {
+      filters_.clear();
+    }
+    filters_[key] = std::move(filter);
+  }
+
+  struct BindRecorder::State {
+    // The connection may be closed while this is alive.
+    duckdb::shared_ptr<duckdb::ClientContext> context;
+    duckdb::shared_ptr<BindRecorderState> bind_recorder_state;
+    duckdb::shared_ptr<BindRecorderState> previous_bind_recorder_state;
+  };
+
+  BindRecorder::BindRecorder(duckdb_connection connection)
+    : state_(std::make_unique<State>())
+  {
+    auto duckdb_connection = reinterpret_cast<duckdb::Connection *>(connection);
+    state_->context = duckdb_connection->context;
+    auto &registered_state = state_->context->registered_state;
+    state_->previous_bind_recorder_state = context_bind_recorder(*state_->context);
+    state_->bind_recorder_state = duckdb::make_shared_ptr<BindRecorderState>();
+    registered_state->Remove(BindRecorderState::key);
+    registered_state->Insert(BindRecorderState::key,
+                             state_->bind_recorder_state);
+  }
+
+  BindRecorder::~BindRecorder()
+  {
+    auto &registered_state = state_->context->registered_state;
+    registered_state->Remove(BindRecorderState::key);
+    if (state_->previous_bind_recorder_state) {
+      registered_state->Insert(BindRecorderState::key,
+                               state_->previous_bind_recorder_state);
+    }
+  }
+
+  std::vector<const Registration *>
+  BindRecorder::registrations() const
+  {
+    return state_->bind_recorder_state->registrations();
+  }
+
+  std::vector<std::string>
+  BindRecorder::names() const
+  {
+    return state_->bind_recorder_state->names();
+  }
+
+  arrow::Result<std::shared_ptr<arrow::dataset::Dataset>>
+  open_ipc_file_dataset(const std::string &path)
+  {
+    auto file_system_options = arrow::fs::LocalFileSystemOptions::Defaults();
+    file_system_options.use_mmap = true;
+    auto file_system =
+      std::make_shared<arrow::fs::LocalFileSystem>(file_system_options);
+    auto format = std::make_shared<arrow::dataset::IpcFileFormat>();
+    arrow::dataset::FileSystemFactoryOptions factory_options;
+    ARROW_ASSIGN_OR_RAISE(
+      auto factory,
+      arrow::dataset::FileSystemDatasetFactory::Make(file_system,
+                                                     {path},
+                                                     format,
+                                                     factory_options));
+    return factory->Finish();
+  }
+
   void
   connection_unregister(duckdb_connection connection, VALUE name)
   {
@@ -243,21 +1790,127 @@ namespace arrow_duckdb {
       ->Query(std::string("DROP VIEW \"") + c_name + "\"");
   }
 
-  void
+  std::shared_ptr<Registration>
   connection_register(duckdb_connection connection,
                       VALUE name,
-                      VALUE arrow_table)
+                      VALUE arrow_source,
+                      bool statistics)
   {
     auto c_name = StringValueCStr(name);
-    auto garrow_table = RVAL2GOBJ(arrow_table);
-    reinterpret_cast<duckdb::Connection *>(connection)
+    auto registration =
+      std::make_shared<Registration>(G_OBJECT(RVAL2GOBJ(arrow_source)),
+                                     statistics);
+    auto duckdb_connection = reinterpret_cast<duckdb::Connection *>(connection);
+    initialize_database(*duckdb_connection);
+    duckdb_connection
       ->TableFunction(
-        "arrow_scan",
+        ArrowDuckDBScan::name,
         {
-          duckdb::Value::POINTER(reinterpret_cast<uintptr_t>(garrow_table)),
+          duckdb::Value::POINTER(reinterpret_cast<uintptr_t>(registration.get())),
           duckdb::Value::POINTER(reinterpret_cast<uintptr_t>(arrow_table_produce)),
           duckdb::Value::POINTER(reinterpret_cast<uintptr_t>(arrow_table_get_schema)),
         })
       ->CreateView(c_name, true, true);
+    return registration;
+  }
+
+  int64_t
+  connection_insert(duckdb_connection connection,
+                    const std::string &table_name,
+                    GObject *source,
+                    bool create)
+  {
+    // We don't need a view. The registration is alive only while
+    // inserting.
+    Registration registration(source, false);
+    auto duckdb_connection = reinterpret_cast<duckdb::Connection *>(connection);
+    initialize_database(*duckdb_connection);
+    auto relation = duckdb_connection->TableFunction(
+      ArrowDuckDBScan::name,
+      {
+        duckdb::Value::POINTER(reinterpret_cast<uintptr_t>(&registration)),
+        duckdb::Value::POINTER(reinterpret_cast<uintptr_t>(arrow_table_produce)),
+        duckdb::Value::POINTER(reinterpret_cast<uintptr_t>(arrow_table_get_schema)),
+      });
+    // table_name may be qualified such as "schema.table" and
+    // "catalog.schema.table".
+    auto qualified_name = duckdb::QualifiedName::Parse(table_name);
+    if (create &&
+        !duckdb_connection->TableInfo(qualified_name.catalog,
+                                      qualified_name.schema,
+                                      qualified_name.name)) {
+      relation->Create(qualified_name.catalog,
+                       qualified_name.schema,
+                       qualified_name.name);
+    } else {
+      relation->Insert(qualified_name.catalog,
+                       qualified_name.schema,
+                       qualified_name.name);
+    }
+    auto statistics = registration.last_scan_statistics();
+    if (!statistics) {
+      return 0;
+    }
+    return statistics->n_rows;
+  }
+
+  void
+  connection_set_source_resolver(duckdb_connection connection,
+                                 SourceResolver resolver)
+  {
+    auto duckdb_connection = reinterpret_cast<duckdb::Connection *>(connection);
+    auto &context = *(duckdb_connection->context);
+    if (!resolver) {
+      context.registered_state->Remove(SourceResolverState::key);
+      return;
+    }
+    initialize_database(*duckdb_connection);
+    context.registered_state->Insert(
+      SourceResolverState::key,
+      duckdb::make_shared_ptr<SourceResolverState>(std::move(resolver)));
+  }
+
+  void
+  SharedRegistrations::add(const std::string &name,
+                           std::shared_ptr<Registration> registration)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    registrations_[name] = std::move(registration);
+  }
+
+  bool
+  SharedRegistrations::remove(const std::string &name)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return registrations_.erase(name) > 0;
+  }
+
+  std::shared_ptr<Registration>
+  SharedRegistrations::lookup(const std::string &name)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = registrations_.find(name);
+    if (it == registrations_.end()) {
+      return nullptr;
+    }
+    return it->second;
+  }
+
+  void
+  connection_set_shared_registrations(
+    duckdb_connection connection,
+    std::shared_ptr<SharedRegistrations> registrations)
+  {
+    auto duckdb_connection = reinterpret_cast<duckdb::Connection *>(connection);
+    auto &context = *(duckdb_connection->context);
+    if (!registrations) {
+      context.registered_state->Remove(SharedRegistrationsState::key);
+      return;
+    }
+    initialize_database(*duckdb_connection);
+    context.registered_state->Insert(
+      SharedRegistrationsState::key,
+      duckdb::make_shared_ptr<SharedRegistrationsState>(
+        std::move(registrations)));
   }
 }
@@ -16,12 +16,183 @@
 
 #pragma once
 
+#include <arrow/compute/api.h>
+#include <arrow/dataset/api.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 namespace arrow_duckdb {
+  // Counters of one scan of a registered Arrow data.
+  struct ScanStatistics {
+    // Filters evaluated by Apache Arrow.
+    std::vector<std::string> pushed_filters;
+    // Filters left to DuckDB.
+    std::vector<std::string> retained_filters;
+    std::atomic<int64_t> n_batches{0};
+    std::atomic<int64_t> n_rows{0};
+    // Wall time in the Apache Arrow scanner including evaluating
+    // pushed down filters.
+    std::atomic<int64_t> scan_time_ns{0};
+    // Rows removed by pushed down filters. -1 until the scan
+    // finishes or when the number of input rows is unknown.
+    std::atomic<int64_t> n_removed_rows{-1};
+  };
+
+  // Pushed down filters converted to an Apache Arrow expression.
+  struct ScanFilter {
+    // Bound to the registered schema.
+    arrow::compute::Expression expression;
+    std::vector<std::string> pushed_filters;
+    std::vector<std::string> retained_filters;
+    // Columns whose filters Apache Arrow can't evaluate. DuckDB
+    // evaluates them after the scan.
+    std::vector<std::string> retained_columns;
+  };
+
+  // Computed by Apache Arrow compute at registration.
+  struct ColumnStatistics {
+    int64_t n_rows;
+    int64_t n_nulls;
+    // nullptr when all values are null.
+    std::shared_ptr<arrow::Scalar> min;
+    std::shared_ptr<arrow::Scalar> max;
+  };
+
+  // State of a registered Arrow data. DuckDB's view refers this. We
+  // prepare the dataset and the schema only once here because DuckDB
+  // may scan the same registered data many times.
+  class Registration {
+  public:
+    // Column statistics are computed only when compute_statistics
+    // is true because it scans all values.
+    Registration(GObject *source, bool compute_statistics);
+    ~Registration();
+
+    GObject *source() const { return source_; }
+    const std::shared_ptr<arrow::Schema> &schema() const { return schema_; }
+    // nullptr for a record batch reader.
+    const std::shared_ptr<arrow::dataset::Dataset> &dataset() const {
+      return dataset_;
+    }
+    // nullptr except for a table.
+    const std::shared_ptr<arrow::Table> &table() const { return table_; }
+    // The batch size for a scan by n_threads threads.
+    int64_t batch_size(int64_t n_threads) const;
+    // -1 when unknown.
+    int64_t n_rows() const { return n_rows_; }
+    // true when a Ruby thread produces record batches such as an
+    // Enumerable. A query that holds the GVL can't scan it.
+    bool needs_ruby() const { return needs_ruby_; }
+    // nullptr when not computed.
+    std::shared_ptr<ColumnStatistics> column_statistics(size_t i) const {
+      if (i >= column_statistics_.size()) {
+        return nullptr;
+      }
+      return column_statistics_[i];
+    }
+
+    std::shared_ptr<ScanStatistics> start_scan();
+    // nullptr when not scanned yet.
+    std::shared_ptr<ScanStatistics> last_scan_statistics();
+
+    // key identifies pushed down filters. nullptr when not cached.
+    std::shared_ptr<const ScanFilter> lookup_filter(const std::string &key);
+    void cache_filter(const std::string &key,
+                      std::shared_ptr<const ScanFilter> filter);
+
+  private:
+    GObject *source_;
+    std::shared_ptr<arrow::Schema> schema_;
+    std::shared_ptr<arrow::dataset::Dataset> dataset_;
+    std::shared_ptr<arrow::Table> table_;
+    int64_t n_rows_;
+    bool needs_ruby_;
+    std::vector<std::shared_ptr<ColumnStatistics>> column_statistics_;
+    std::mutex mutex_;
+    std::shared_ptr<ScanStatistics> last_scan_statistics_;
+    std::unordered_map<std::string, std::shared_ptr<const ScanFilter>>
+      filters_;
+  };
+
+  // Registrations shared by connections such as connections in a
+  // pool. A registration is alive while it's registered or a query
+  // refers it.
+  class SharedRegistrations {
+  public:
+    void add(const std::string &name,
+             std::shared_ptr<Registration> registration);
+    // Returns false when name isn't registered.
+    bool remove(const std::string &name);
+    // nullptr when name isn't registered.
+    std::shared_ptr<Registration> lookup(const std::string &name);
+
+  private:
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Registration>>
+      registrations_;
+  };
+
+  // Queries of connection use registrations for unknown table names
+  // by a replacement scan before the source resolver. No catalog
+  // entry is created. nullptr registrations disables it.
   void
-  connection_unregister(duckdb_connection connection, VALUE name);
+  connection_set_shared_registrations(
+    duckdb_connection connection,
+    std::shared_ptr<SharedRegistrations> registrations);
+
+  // Records registrations bound by queries of connection while this
+  // is alive. Unlike scan statistics, this also records registrations
+  // that are never scanned such as ones in "LIMIT 0" queries.
+  class BindRecorder {
+  public:
+    explicit BindRecorder(duckdb_connection connection);
+    ~BindRecorder();
+
+    // Registrations bound by views.
+    std::vector<const Registration *> registrations() const;
+    // Names bound by replacement scans.
+    std::vector<std::string> names() const;
+
+  private:
+    struct State;
+    std::unique_ptr<State> state_;
+  };
+
+  // Opens an Apache Arrow IPC file as a dataset. The file is memory
+  // mapped. So record batches are scanned in place and processes
+  // share the page cache. path must be absolute.
+  arrow::Result<std::shared_ptr<arrow::dataset::Dataset>>
+  open_ipc_file_dataset(const std::string &path);
+
   void
+  connection_unregister(duckdb_connection connection, VALUE name);
+  std::shared_ptr<Registration>
   connection_register(duckdb_connection connection,
                       VALUE name,
-                      VALUE arrow_table);
+                      VALUE arrow_source,
+                      bool statistics);
+  // Resolves an unknown table name in a query to an Apache Arrow
+  // table, record batch reader or dataset. This returns a new
+  // reference or nullptr for an unknown name.
+  using SourceResolver =
+    std::function<arrow::Result<GObject *>(const std::string &name)>;
+  // Queries of connection use resolver for unknown table names by
+  // a replacement scan. No catalog entry is created. nullptr
+  // resolver disables it.
+  void
+  connection_set_source_resolver(duckdb_connection connection,
+                                 SourceResolver resolver);
+  // Returns the number of inserted rows. This may be called without
+  // the GVL. This throws an exception on error.
+  int64_t
+  connection_insert(duckdb_connection connection,
+                    const std::string &table_name,
+                    GObject *source,
+                    bool create);
 }
-
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arrow/c/bridge.h>
+
+#include <duckdb.hpp>
+#ifndef DUCKDB_AMALGAMATION
+#  include <duckdb.h>
+#  include <duckdb/common/arrow/arrow_converter.hpp>
+#  include <duckdb/main/client_config.hpp>
+#  include <duckdb/main/client_context.hpp>
+#  include <duckdb/main/client_properties.hpp>
+#  include <duckdb/main/connection.hpp>
+#  include <duckdb/main/query_profiler.hpp>
+#endif
+
+#include "arrow-duckdb-result.hpp"
+
+namespace {
+  // This uses DuckDB's Apache Arrow export. So the schema always
+  // matches exported arrays.
+  arrow::Result<std::shared_ptr<arrow::Schema>>
+  types_to_schema(duckdb_connection connection,
+                  const duckdb::vector<duckdb::LogicalType> &types,
+                  const duckdb::vector<std::string> &names)
+  {
+    auto duckdb_connection = reinterpret_cast<duckdb::Connection *>(connection);
+    auto properties = duckdb_connection->context->GetClientProperties();
+    ArrowSchema c_abi_schema;
+    try {
+      duckdb::ArrowConverter::ToArrowSchema(&c_abi_schema,
+                                            types,
+                                            names,
+                                            properties);
+    } catch (const std::exception &error) {
+      return arrow::Status::NotImplemented(
+        "[arrow-duckdb][result][schema] ", error.what());
+    }
+    return arrow::ImportSchema(&c_abi_schema);
+  }
+}
+
+namespace arrow_duckdb {
+  arrow::Result<std::shared_ptr<arrow::Schema>>
+  result_schema(duckdb_connection connection, duckdb_result *result)
+  {
+    duckdb::vector<duckdb::LogicalType> types;
+    duckdb::vector<std::string> names;
+    auto n_columns = duckdb_column_count(result);
+    for (idx_t i = 0; i < n_columns; ++i) {
+      auto type = duckdb_column_logical_type(result, i);
+      // duckdb_logical_type is duckdb::LogicalType * in DuckDB.
+      types.push_back(*reinterpret_cast<duckdb::LogicalType *>(type));
+      duckdb_destroy_logical_type(&type);
+      names.push_back(duckdb_column_name(result, i));
+    }
+    return types_to_schema(connection, types, names);
+  }
+
+  arrow::Result<std::shared_ptr<arrow::Schema>>
+  prepared_statement_schema(duckdb_connection connection,
+                            duckdb_prepared_statement prepared_statement)
+  {
+    duckdb::vector<duckdb::LogicalType> types;
+    duckdb::vector<std::string> names;
+    auto n_columns = duckdb_prepared_statement_column_count(prepared_statement);
+    for (idx_t i = 0; i < n_columns; ++i) {
+      auto type =
+        duckdb_prepared_statement_column_logical_type(prepared_statement, i);
+      types.push_back(*reinterpret_cast<duckdb::LogicalType *>(type));
+      duckdb_destroy_logical_type(&type);
+      auto name = duckdb_prepared_statement_column_name(prepared_statement, i);
+      names.push_back(name);
+      duckdb_free(const_cast<char *>(name));
+    }
+    return types_to_schema(connection, types, names);
+  }
+
+  struct ProfilingScope::State {
+    duckdb::ClientContext *context;
+    std::string *json;
+    bool enable_profiler;
+    bool emit_profiler_output;
+    duckdb::ProfilerPrintFormat profiler_print_format;
+
+    State(duckdb::ClientContext *context, std::string *json)
+      : context(context),
+        json(json)
+    {
+      auto &config = duckdb::ClientConfig::GetConfig(*context);
+      enable_profiler = config.enable_profiler;
+      emit_profiler_output = config.emit_profiler_output;
+      profiler_print_format = config.profiler_print_format;
+      config.enable_profiler = true;
+      // We don't print the profile. We return it.
+      config.emit_profiler_output = false;
+      config.profiler_print_format = duckdb::ProfilerPrintFormat::JSON;
+    }
+
+    ~State()
+    {
+      try {
+        *json = duckdb::QueryProfiler::Get(*context).ToJSON();
+      } catch (const std::exception &) {
+        json->clear();
+      }
+      auto &config = duckdb::ClientConfig::GetConfig(*context);
+      config.enable_profiler = enable_profiler;
+      config.emit_profiler_output = emit_profiler_output;
+      config.profiler_print_format = profiler_print_format;
+    }
+  };
+
+  ProfilingScope::ProfilingScope(duckdb_connection connection,
+                                 std::string *json)
+    : state_()
+  {
+    if (json) {
+      auto duckdb_connection =
+        reinterpret_cast<duckdb::Connection *>(connection);
+      state_ = std::make_unique<State>(duckdb_connection->context.get(), json);
+    }
+  }
+
+  ProfilingScope::~ProfilingScope() = default;
+
+  struct StringTypeScope::State {
+    duckdb::ClientContext *context;
+    duckdb::ArrowOffsetSize arrow_offset_size;
+    bool produce_arrow_string_view;
+
+    State(duckdb::ClientContext *context, StringType string_type)
+      : context(context)
+    {
+      auto &config = duckdb::ClientConfig::GetConfig(*context);
+      arrow_offset_size = config.arrow_offset_size;
+      produce_arrow_string_view = config.produce_arrow_string_view;
+      if (string_type == StringType::LARGE_STRING) {
+        config.arrow_offset_size = duckdb::ArrowOffsetSize::LARGE;
+        config.produce_arrow_string_view = false;
+      } else {
+        config.arrow_offset_size = duckdb::ArrowOffsetSize::REGULAR;
+        config.produce_arrow_string_view = true;
+      }
+    }
+
+    ~State()
+    {
+      auto &config = duckdb::ClientConfig::GetConfig(*context);
+      config.arrow_offset_size = arrow_offset_size;
+      config.produce_arrow_string_view = produce_arrow_string_view;
+    }
+
+    static bool
+    is_needed(StringType string_type)
+    {
+      return string_type == StringType::LARGE_STRING ||
+        string_type == StringType::STRING_VIEW;
+    }
+  };
+
+  StringTypeScope::StringTypeScope(duckdb_connection connection,
+                                   StringType string_type)
+    : state_()
+  {
+    if (State::is_needed(string_type)) {
+      auto duckdb_connection =
+        reinterpret_cast<duckdb::Connection *>(connection);
+      state_ = std::make_unique<State>(duckdb_connection->context.get(),
+                                       string_type);
+    }
+  }
+
+  StringTypeScope::~StringTypeScope() = default;
+}
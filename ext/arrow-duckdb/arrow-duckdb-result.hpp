@@ -0,0 +1,79 @@
+/*
+ * Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <arrow/result.h>
+#include <arrow/status.h>
+#include <arrow/type_fwd.h>
+
+#include <memory>
+#include <string>
+
+namespace arrow_duckdb {
+  // Enables DuckDB's profiler while this is alive. The profile is
+  // stored to json as JSON on destruction. This does nothing when
+  // json is nullptr.
+  class ProfilingScope {
+  public:
+    ProfilingScope(duckdb_connection connection, std::string *json);
+    ~ProfilingScope();
+
+  private:
+    struct State;
+    std::unique_ptr<State> state_;
+  };
+
+  // The Apache Arrow type of VARCHAR result columns.
+  enum class StringType {
+    STRING,
+    // LARGE_STRING also uses 64-bit offsets for BLOB and LIST
+    // columns.
+    LARGE_STRING,
+    STRING_VIEW,
+    // DuckDB doesn't export dictionary arrays. ResultReader encodes
+    // each record batch.
+    DICTIONARY,
+  };
+
+  // Makes DuckDB export VARCHAR columns as string_type while this is
+  // alive. The type is fixed when a result is created. This does
+  // nothing for StringType::STRING and StringType::DICTIONARY.
+  class StringTypeScope {
+  public:
+    StringTypeScope(duckdb_connection connection, StringType string_type);
+    ~StringTypeScope();
+
+  private:
+    struct State;
+    std::unique_ptr<State> state_;
+  };
+
+  // Builds the Apache Arrow schema of a DuckDB result including a
+  // streaming result. duckdb_query_arrow_schema() doesn't work with
+  // streaming results. This must be called while scopes used for
+  // executing result such as StringTypeScope are alive because
+  // DuckDB uses the same options when it exports arrays.
+  arrow::Result<std::shared_ptr<arrow::Schema>>
+  result_schema(duckdb_connection connection, duckdb_result *result);
+
+  // Builds the Apache Arrow schema of the result of a prepared
+  // statement without executing it. This must be called while the
+  // same scopes as result_schema() are alive.
+  arrow::Result<std::shared_ptr<arrow::Schema>>
+  prepared_statement_schema(duckdb_connection connection,
+                            duckdb_prepared_statement prepared_statement);
+}
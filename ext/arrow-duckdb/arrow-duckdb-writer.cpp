@@ -0,0 +1,168 @@
+/*
+ * Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arrow/io/file.h>
+#include <arrow/ipc/api.h>
+#include <arrow/util/compression.h>
+
+#include <parquet/arrow/writer.h>
+#include <parquet/properties.h>
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "arrow-duckdb-writer.hpp"
+
+namespace {
+  arrow::Result<int64_t>
+  write_parquet_file(arrow::RecordBatchReader *reader,
+                     const std::string &path,
+                     const arrow_duckdb::ParquetWriteOptions &options,
+                     arrow::MemoryPool *pool)
+  {
+    parquet::WriterProperties::Builder builder;
+    builder.memory_pool(pool);
+    if (options.row_group_size > 0) {
+      builder.max_row_group_length(options.row_group_size);
+    }
+    if (!options.compression.empty()) {
+      ARROW_ASSIGN_OR_RAISE(
+        auto compression,
+        arrow::util::Codec::GetCompressionType(options.compression));
+      builder.compression(compression);
+    }
+    auto writer_properties = builder.build();
+    // The Apache Arrow schema is stored in the metadata. So Apache
+    // Arrow readers restore types that Apache Parquet doesn't have
+    // such as time zones, large strings and dictionaries.
+    auto arrow_writer_properties =
+      parquet::ArrowWriterProperties::Builder().store_schema()->build();
+    ARROW_ASSIGN_OR_RAISE(auto sink, arrow::io::FileOutputStream::Open(path));
+    ARROW_ASSIGN_OR_RAISE(
+      auto writer,
+      parquet::arrow::FileWriter::Open(*(reader->schema()),
+                                       pool,
+                                       sink,
+                                       writer_properties,
+                                       arrow_writer_properties));
+    int64_t n_rows = 0;
+    while (true) {
+      std::shared_ptr<arrow::RecordBatch> record_batch;
+      ARROW_RETURN_NOT_OK(reader->ReadNext(&record_batch));
+      if (!record_batch) {
+        break;
+      }
+      // Record batches are buffered until the row group is filled.
+      ARROW_RETURN_NOT_OK(writer->WriteRecordBatch(*record_batch));
+      n_rows += record_batch->num_rows();
+    }
+    ARROW_RETURN_NOT_OK(writer->Close());
+    ARROW_RETURN_NOT_OK(sink->Close());
+    return n_rows;
+  }
+
+  arrow::Result<int64_t>
+  write_ipc_file(arrow::RecordBatchReader *reader,
+                 const std::string &path,
+                 const std::string &compression,
+                 arrow::MemoryPool *pool)
+  {
+    auto options = arrow::ipc::IpcWriteOptions::Defaults();
+    options.memory_pool = pool;
+    if (!compression.empty()) {
+      ARROW_ASSIGN_OR_RAISE(
+        auto compression_type,
+        arrow::util::Codec::GetCompressionType(compression));
+      ARROW_ASSIGN_OR_RAISE(options.codec,
+                            arrow::util::Codec::Create(compression_type));
+    }
+    ARROW_ASSIGN_OR_RAISE(auto sink, arrow::io::FileOutputStream::Open(path));
+    ARROW_ASSIGN_OR_RAISE(
+      auto writer,
+      arrow::ipc::MakeFileWriter(sink, reader->schema(), options));
+    int64_t n_rows = 0;
+    while (true) {
+      std::shared_ptr<arrow::RecordBatch> record_batch;
+      ARROW_RETURN_NOT_OK(reader->ReadNext(&record_batch));
+      if (!record_batch) {
+        break;
+      }
+      ARROW_RETURN_NOT_OK(writer->WriteRecordBatch(*record_batch));
+      n_rows += record_batch->num_rows();
+    }
+    ARROW_RETURN_NOT_OK(writer->Close());
+    ARROW_RETURN_NOT_OK(sink->Close());
+    return n_rows;
+  }
+
+  // Writes to a temporary file in the same directory and renames it
+  // to path on success. A failed write removes the temporary file
+  // and doesn't touch path. So it doesn't leave a truncated file.
+  template <typename Write>
+  arrow::Result<int64_t>
+  write_atomically(const std::string &path, Write write)
+  {
+    static std::atomic<uint64_t> n_temporary_paths{0};
+    auto temporary_path =
+      path + ".tmp." +
+      std::to_string(getpid()) + "." +
+      std::to_string(n_temporary_paths++);
+    auto n_rows_result = write(temporary_path);
+    if (!n_rows_result.ok()) {
+      std::remove(temporary_path.c_str());
+      return n_rows_result;
+    }
+    if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+      auto error = errno;
+      std::remove(temporary_path.c_str());
+      return arrow::Status::IOError("[arrow-duckdb][write] failed to rename: ",
+                                    temporary_path,
+                                    " -> ",
+                                    path,
+                                    ": ",
+                                    std::strerror(error));
+    }
+    return n_rows_result;
+  }
+}
+
+namespace arrow_duckdb {
+  arrow::Result<int64_t>
+  write_parquet(arrow::RecordBatchReader *reader,
+                const std::string &path,
+                const ParquetWriteOptions &options,
+                arrow::MemoryPool *pool)
+  {
+    return write_atomically(path, [&](const std::string &temporary_path) {
+      return write_parquet_file(reader, temporary_path, options, pool);
+    });
+  }
+
+  arrow::Result<int64_t>
+  write_ipc(arrow::RecordBatchReader *reader,
+            const std::string &path,
+            const std::string &compression,
+            arrow::MemoryPool *pool)
+  {
+    return write_atomically(path, [&](const std::string &temporary_path) {
+      return write_ipc_file(reader, temporary_path, compression, pool);
+    });
+  }
+}
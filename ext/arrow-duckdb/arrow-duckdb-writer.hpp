@@ -0,0 +1,53 @@
+/*
+ * Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <arrow/api.h>
+
+#include <string>
+
+namespace arrow_duckdb {
+  struct ParquetWriteOptions {
+    // 0 means the default.
+    int64_t row_group_size = 0;
+    // Empty means the default.
+    std::string compression;
+  };
+
+  // Writes all record batches of reader to path as Apache Parquet.
+  // Record batches are written as they are read. They are written to
+  // a temporary file that is renamed to path on success. So path
+  // isn't changed on failure. Buffers for encoding and compression
+  // are allocated from pool. Returns the number of written rows.
+  // This doesn't use Ruby API.
+  arrow::Result<int64_t>
+  write_parquet(arrow::RecordBatchReader *reader,
+                const std::string &path,
+                const ParquetWriteOptions &options,
+                arrow::MemoryPool *pool);
+
+  // Writes all record batches of reader to path as Apache Arrow IPC
+  // file format. path isn't changed on failure like write_parquet().
+  // Empty compression means no compression. Buffers for compression
+  // are allocated from pool. Returns the number of written rows.
+  // This doesn't use Ruby API.
+  arrow::Result<int64_t>
+  write_ipc(arrow::RecordBatchReader *reader,
+            const std::string &path,
+            const std::string &compression,
+            arrow::MemoryPool *pool);
+}
@@ -15,211 +15,3247 @@
  */
 
 #include <arrow-glib/arrow-glib.hpp>
+#include <arrow-dataset-glib/arrow-dataset-glib.hpp>
 
+#include <arrow/array/concatenate.h>
 #include <arrow/c/bridge.h>
+#include <arrow/compute/api.h>
+#include <arrow/util/byte_size.h>
 
 #include <rbgobject.h>
 
+#include <ruby/io.h>
+#include <ruby/thread.h>
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+
 extern "C" {
 #include <ruby-duckdb.h>
 }
 
-#include "arrow-duckdb-registration.hpp"
+extern "C" int ruby_native_thread_p(void);
+extern "C" int ruby_thread_has_gvl_p(void);
+
+#include "arrow-duckdb-function.hpp"
+#include "arrow-duckdb-gvl.hpp"
+#include "arrow-duckdb-memory-pool.hpp"
+#include "arrow-duckdb-record-batch-queue.hpp"
+#include "arrow-duckdb-result.hpp"
+#include "arrow-duckdb-writer.hpp"
+#include "arrow-duckdb-registration.hpp"
+
+extern "C" void Init_arrow_duckdb(void);
+
+namespace {
+  VALUE cArrowArray;
+  VALUE cArrowTable;
+  VALUE cArrowRecordBatch;
+  VALUE cArrowRecordBatchReader;
+  VALUE cArrowDatasetDataset;
+  VALUE cArrowDuckDBResult;
+  VALUE cArrowDuckDBRegistration;
+  VALUE cArrowDuckDBAsyncQuery;
+  VALUE cArrowDuckDBMemoryPool;
+
+  template <typename Function>
+  void *
+  without_gvl_body(void *user_data)
+  {
+    auto function = static_cast<Function *>(user_data);
+    (*function)();
+    return nullptr;
+  }
+
+  void
+  without_gvl_interrupt(void *user_data)
+  {
+    duckdb_interrupt(static_cast<duckdb_connection>(user_data));
+  }
+
+  // Runs function without the GVL. If connection is available,
+  // Thread#raise, Thread#kill and so on interrupt the running query
+  // by duckdb_interrupt() and DuckDB's worker threads can call Ruby
+  // while function runs.
+  template <typename Function>
+  void
+  call_without_gvl(duckdb_connection connection, Function function)
+  {
+    if (connection) {
+      // The scope is created without the GVL. A Ruby exception raised
+      // after rb_thread_call_without_gvl() must not skip its
+      // destructor.
+      auto body = [&]() {
+        arrow_duckdb::GVLReleasedScope gvl_released(connection);
+        function();
+      };
+      rb_thread_call_without_gvl(without_gvl_body<decltype(body)>,
+                                 &body,
+                                 without_gvl_interrupt,
+                                 connection);
+    } else {
+      rb_thread_call_without_gvl(without_gvl_body<Function>,
+                                 &function,
+                                 nullptr,
+                                 nullptr);
+    }
+  }
+
+  duckdb_connection
+  connection_get_raw(VALUE connection)
+  {
+    if (NIL_P(connection)) {
+      return nullptr;
+    }
+    return get_struct_connection(connection)->con;
+  }
+
+  struct QueryOptions {
+    bool stream;
+    int64_t batch_size;
+    bool profile;
+    arrow_duckdb::StringType strings;
+    // -1 means no limit.
+    int64_t memory_limit;
+  };
+
+  arrow_duckdb::StringType
+  string_type_parse(VALUE rb_string_type)
+  {
+    if (NIL_P(rb_string_type)) {
+      return arrow_duckdb::StringType::STRING;
+    }
+    auto name = rb_String(rb_string_type);
+    std::string c_name(RSTRING_PTR(name), RSTRING_LEN(name));
+    if (c_name == "string") {
+      return arrow_duckdb::StringType::STRING;
+    } else if (c_name == "large_string") {
+      return arrow_duckdb::StringType::LARGE_STRING;
+    } else if (c_name == "string_view") {
+      return arrow_duckdb::StringType::STRING_VIEW;
+    } else if (c_name == "dictionary") {
+      return arrow_duckdb::StringType::DICTIONARY;
+    }
+    rb_raise(rb_eArgError,
+             "strings must be :string, :large_string, :string_view or "
+             ":dictionary: %" PRIsVALUE,
+             rb_string_type);
+  }
+
+  void
+  query_options_parse(VALUE rb_options, QueryOptions *options)
+  {
+    options->stream = false;
+    options->batch_size = 0;
+    options->profile = false;
+    options->strings = arrow_duckdb::StringType::STRING;
+    options->memory_limit = -1;
+    if (NIL_P(rb_options)) {
+      return;
+    }
+
+    ID keywords[5];
+    CONST_ID(keywords[0], "stream");
+    CONST_ID(keywords[1], "batch_size");
+    CONST_ID(keywords[2], "profile");
+    CONST_ID(keywords[3], "strings");
+    CONST_ID(keywords[4], "memory_limit");
+    VALUE values[5];
+    rb_get_kwargs(rb_options, keywords, 0, 5, values);
+    if (values[0] != Qundef) {
+      options->stream = RVAL2CBOOL(values[0]);
+    }
+    if (values[1] != Qundef && !NIL_P(values[1])) {
+      options->batch_size = NUM2LL(values[1]);
+      if (options->batch_size <= 0) {
+        rb_raise(rb_eArgError,
+                 "batch_size must be positive: %" PRIsVALUE,
+                 values[1]);
+      }
+    }
+    if (values[2] != Qundef) {
+      options->profile = RVAL2CBOOL(values[2]);
+    }
+    if (values[3] != Qundef) {
+      options->strings = string_type_parse(values[3]);
+    }
+    if (values[4] != Qundef && !NIL_P(values[4])) {
+      options->memory_limit = NUM2LL(values[4]);
+      if (options->memory_limit < 0) {
+        rb_raise(rb_eArgError,
+                 "memory_limit must not be negative: %" PRIsVALUE,
+                 values[4]);
+      }
+    }
+  }
+
+  class DuckDBErrorDetail : public arrow::StatusDetail {
+  public:
+    const char *
+    type_id() const override
+    {
+      return "arrow-duckdb-duckdb-error";
+    }
+
+    std::string
+    ToString() const override
+    {
+      return "DuckDB error";
+    }
+  };
+
+  arrow::Status
+  duckdb_error(const char *context, const char *message)
+  {
+    std::string full_message(context);
+    if (message) {
+      full_message += ": ";
+      full_message += message;
+    }
+    return arrow::Status(arrow::StatusCode::ExecutionError,
+                         full_message,
+                         std::make_shared<DuckDBErrorDetail>());
+  }
+
+  // Raises DuckDB::Error or Arrow::Error for status. status is reset
+  // before raising because raising doesn't run C++ destructors.
+  void
+  check_status(arrow::Status &status, const char *context)
+  {
+    if (status.ok()) {
+      return;
+    }
+
+    VALUE exception;
+    if (dynamic_cast<DuckDBErrorDetail *>(status.detail().get())) {
+      exception = rb_exc_new_cstr(eDuckDBError, status.message().c_str());
+    } else {
+      GError *gerror = nullptr;
+      garrow_error_check(&gerror, status, context);
+      exception = rbgerr_gerror2exception(gerror);
+    }
+    status = arrow::Status::OK();
+    rb_exc_raise(exception);
+  }
+
+  struct PhaseProfile {
+    int64_t wall_time_ns = 0;
+    // CPU time of the process. It includes DuckDB's worker threads.
+    int64_t cpu_time_ns = 0;
+  };
+
+  struct QueryProfile {
+    PhaseProfile execute;
+    // Fetching chunks from DuckDB and importing them by the C data
+    // interface.
+    PhaseProfile fetch;
+    int64_t n_batches = 0;
+    int64_t n_rows = 0;
+    int64_t n_bytes = 0;
+    // DuckDB's profiling tree. Empty for a streaming result.
+    std::string duckdb;
+  };
+
+  // Adds the elapsed time to phase. This does nothing when phase is
+  // nullptr.
+  class PhaseTimer {
+  public:
+    explicit PhaseTimer(PhaseProfile *phase) :
+      phase_(phase)
+    {
+      if (phase_) {
+        wall_start_ = std::chrono::steady_clock::now();
+        cpu_start_ns_ = cpu_time_ns();
+      }
+    }
+
+    ~PhaseTimer()
+    {
+      if (!phase_) {
+        return;
+      }
+      auto elapsed = std::chrono::steady_clock::now() - wall_start_;
+      phase_->wall_time_ns +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+      phase_->cpu_time_ns += cpu_time_ns() - cpu_start_ns_;
+    }
+
+  private:
+    PhaseProfile *phase_;
+    std::chrono::steady_clock::time_point wall_start_;
+    int64_t cpu_start_ns_ = 0;
+
+    static int64_t
+    cpu_time_ns()
+    {
+      timespec time;
+      if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0) {
+        return 0;
+      }
+      return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+    }
+  };
+
+  // Reads a DuckDB query result as Apache Arrow record batches. All
+  // methods don't use Ruby API. So we can call them without the
+  // GVL. Because we release the GVL, multiple Ruby threads may read
+  // the same result concurrently. ReadNext() serializes them.
+  class ResultReader : public arrow::RecordBatchReader {
+  public:
+    // 0 means that each record batch has one DuckDB chunk as is.
+    explicit ResultReader(int64_t batch_size) :
+      batch_size_(batch_size)
+    {
+    }
+
+    ~ResultReader() override
+    {
+      duckdb_destroy_arrow(&arrow_);
+      if (streaming_) {
+        duckdb_destroy_result(&stream_);
+      }
+      duckdb_destroy_prepare(&prepared_statement_);
+    }
+
+    // This must be called before executing a query.
+    void
+    enable_profile()
+    {
+      profile_ = std::make_shared<QueryProfile>();
+    }
+
+    // nullptr when profile isn't enabled.
+    const std::shared_ptr<QueryProfile> &
+    profile() const
+    {
+      return profile_;
+    }
+
+    // This must be called before executing a query.
+    void
+    set_string_type(arrow_duckdb::StringType string_type)
+    {
+      string_type_ = string_type;
+    }
+
+    // This must be called before executing a query. Scans of
+    // registered Apache Arrow data and fetched record batches are
+    // counted by memory_pool.
+    void
+    set_memory_pool(std::shared_ptr<arrow_duckdb::TrackingMemoryPool> pool)
+    {
+      memory_pool_ = std::move(pool);
+    }
+
+    // nullptr when not set.
+    const std::shared_ptr<arrow_duckdb::TrackingMemoryPool> &
+    memory_pool() const
+    {
+      return memory_pool_;
+    }
+
+    arrow::Status
+    query(duckdb_connection connection, const char *sql)
+    {
+      duckdb_state state;
+      {
+        PhaseTimer timer(execute_profile());
+        arrow_duckdb::ProfilingScope profiling(connection, duckdb_profile());
+        arrow_duckdb::StringTypeScope string_type(connection, string_type_);
+        arrow_duckdb::QueryMemoryPoolScope memory_pool(connection,
+                                                       memory_pool_);
+        state = duckdb_query_arrow(connection, sql, &arrow_);
+      }
+      if (state == DuckDBError) {
+        return duckdb_error("Failed to execute query", arrow_error());
+      }
+      return import_materialized_schema();
+    }
+
+    arrow::Status
+    execute(duckdb_connection connection,
+            duckdb_prepared_statement prepared_statement)
+    {
+      duckdb_state state;
+      {
+        PhaseTimer timer(execute_profile());
+        arrow_duckdb::ProfilingScope profiling(connection, duckdb_profile());
+        arrow_duckdb::StringTypeScope string_type(connection, string_type_);
+        arrow_duckdb::QueryMemoryPoolScope memory_pool(connection,
+                                                       memory_pool_);
+        state = duckdb_execute_prepared_arrow(prepared_statement, &arrow_);
+      }
+      if (state == DuckDBError) {
+        return duckdb_error("Failed to execute prepared statement",
+                            arrow_error());
+      }
+      return import_materialized_schema();
+    }
+
+    arrow::Status
+    query_streaming(duckdb_connection connection, const char *sql)
+    {
+      duckdb_state state;
+      {
+        PhaseTimer timer(execute_profile());
+        state = duckdb_prepare(connection, sql, &prepared_statement_);
+      }
+      if (state == DuckDBError) {
+        return duckdb_error("Failed to prepare query",
+                            duckdb_prepare_error(prepared_statement_));
+      }
+      return execute_streaming(connection, prepared_statement_);
+    }
+
+    // Starts a streaming query. We don't materialize the whole result
+    // set. Each duckdb_stream_fetch_chunk() executes the query only
+    // until the next chunk is available. Another query on connection
+    // invalidates the streaming result.
+    arrow::Status
+    execute_streaming(duckdb_connection connection,
+                      duckdb_prepared_statement prepared_statement)
+    {
+      PhaseTimer timer(execute_profile());
+      arrow_duckdb::StringTypeScope string_type(connection, string_type_);
+      arrow_duckdb::QueryMemoryPoolScope memory_pool(connection,
+                                                     memory_pool_);
+      duckdb_pending_result pending_result = nullptr;
+      auto state = duckdb_pending_prepared_streaming(prepared_statement,
+                                                     &pending_result);
+      if (state == DuckDBError) {
+        auto status =
+          duckdb_error("Failed to execute streaming query",
+                       pending_result ?
+                       duckdb_pending_error(pending_result) :
+                       nullptr);
+        duckdb_destroy_pending(&pending_result);
+        return status;
+      }
+      streaming_ = true;
+      state = duckdb_execute_pending(pending_result, &stream_);
+      duckdb_destroy_pending(&pending_result);
+      if (state == DuckDBError) {
+        return duckdb_error("Failed to execute streaming query",
+                            duckdb_result_error(&stream_));
+      }
+      memory_pool_ref_ =
+        std::make_unique<arrow_duckdb::ConnectionMemoryPoolRef>(connection);
+      ARROW_ASSIGN_OR_RAISE(schema_,
+                            arrow_duckdb::result_schema(connection, &stream_));
+      return update_output_schema();
+    }
+
+    // Reads record batches of table instead of a DuckDB result. Data
+    // of table aren't copied.
+    void
+    read_table(const std::shared_ptr<arrow::Table> &table)
+    {
+      table_ = table;
+      table_reader_ = std::make_unique<arrow::TableBatchReader>(*table_);
+      schema_ = table_->schema();
+      output_schema_ = schema_;
+    }
+
+    std::shared_ptr<arrow::Schema>
+    schema() const override
+    {
+      return output_schema_;
+    }
+
+    arrow::Status
+    ReadNext(std::shared_ptr<arrow::RecordBatch> *record_batch) override
+    {
+      std::lock_guard<std::mutex> lock(read_mutex_);
+      auto status = read_next_internal(record_batch);
+      if (status.ok()) {
+        status = encode_strings(record_batch);
+      }
+      if (status.IsOutOfMemory()) {
+        record_batch->reset();
+        return duckdb_error("Failed to fetch Apache Arrow array",
+                            status.message().c_str());
+      }
+      return status;
+    }
+
+    bool
+    is_streaming() const
+    {
+      return streaming_;
+    }
+
+    idx_t
+    n_columns()
+    {
+      if (table_) {
+        return table_->num_columns();
+      } else if (streaming_) {
+        return duckdb_column_count(&stream_);
+      } else {
+        return duckdb_arrow_column_count(arrow_);
+      }
+    }
+
+    idx_t
+    n_rows()
+    {
+      if (table_) {
+        return table_->num_rows();
+      }
+      return duckdb_arrow_row_count(arrow_);
+    }
+
+    idx_t
+    n_changed_rows()
+    {
+      if (table_) {
+        return 0;
+      } else if (streaming_) {
+        return duckdb_rows_changed(&stream_);
+      } else {
+        return duckdb_arrow_rows_changed(arrow_);
+      }
+    }
+
+  private:
+    duckdb_arrow arrow_ = nullptr;
+    bool streaming_ = false;
+    duckdb_prepared_statement prepared_statement_ = nullptr;
+    duckdb_result stream_ = {};
+    // The schema exported by DuckDB.
+    std::shared_ptr<arrow::Schema> schema_;
+    // The schema of returned record batches.
+    std::shared_ptr<arrow::Schema> output_schema_;
+    int64_t batch_size_;
+    // The not returned rows of the last read chunk.
+    std::shared_ptr<arrow::RecordBatch> rest_chunk_;
+    std::shared_ptr<QueryProfile> profile_;
+    arrow_duckdb::StringType string_type_ = arrow_duckdb::StringType::STRING;
+    std::shared_ptr<arrow_duckdb::TrackingMemoryPool> memory_pool_;
+    // Only for streaming results.
+    std::unique_ptr<arrow_duckdb::ConnectionMemoryPoolRef> memory_pool_ref_;
+    // Only for read_table().
+    std::shared_ptr<arrow::Table> table_;
+    std::unique_ptr<arrow::TableBatchReader> table_reader_;
+    // DuckDB results and rest_chunk_ aren't thread-safe.
+    std::mutex read_mutex_;
+
+    arrow::MemoryPool *
+    arrow_memory_pool()
+    {
+      if (memory_pool_) {
+        return memory_pool_.get();
+      }
+      return arrow::default_memory_pool();
+    }
+
+    PhaseProfile *
+    execute_profile()
+    {
+      return profile_ ? &(profile_->execute) : nullptr;
+    }
+
+    std::string *
+    duckdb_profile()
+    {
+      return profile_ ? &(profile_->duckdb) : nullptr;
+    }
+
+    arrow::Status
+    read_next_internal(std::shared_ptr<arrow::RecordBatch> *record_batch)
+    {
+      if (batch_size_ == 0) {
+        return read_chunk(record_batch);
+      }
+
+      arrow::RecordBatchVector chunks;
+      int64_t n_rows = 0;
+      while (n_rows < batch_size_) {
+        std::shared_ptr<arrow::RecordBatch> chunk;
+        if (rest_chunk_) {
+          chunk = std::move(rest_chunk_);
+        } else {
+          ARROW_RETURN_NOT_OK(read_chunk(&chunk));
+        }
+        if (!chunk) {
+          break;
+        }
+        auto n_required_rows = batch_size_ - n_rows;
+        if (chunk->num_rows() > n_required_rows) {
+          rest_chunk_ = chunk->Slice(n_required_rows);
+          chunk = chunk->Slice(0, n_required_rows);
+        }
+        n_rows += chunk->num_rows();
+        chunks.push_back(std::move(chunk));
+      }
+      return concatenate_chunks(chunks, n_rows, record_batch);
+    }
+
+    // Encodes VARCHAR columns to dictionary arrays when
+    // StringType::DICTIONARY is used. Other string types are
+    // exported by DuckDB as is.
+    arrow::Status
+    encode_strings(std::shared_ptr<arrow::RecordBatch> *record_batch)
+    {
+      if (string_type_ != arrow_duckdb::StringType::DICTIONARY ||
+          !*record_batch) {
+        return arrow::Status::OK();
+      }
+      auto columns = (*record_batch)->columns();
+      arrow::compute::ExecContext exec_context(arrow_memory_pool());
+      for (auto &column : columns) {
+        if (column->type_id() != arrow::Type::STRING) {
+          continue;
+        }
+        ARROW_ASSIGN_OR_RAISE(
+          auto encoded,
+          arrow::compute::DictionaryEncode(
+            column,
+            arrow::compute::DictionaryEncodeOptions::Defaults(),
+            &exec_context));
+        column = encoded.make_array();
+      }
+      *record_batch = arrow::RecordBatch::Make(output_schema_,
+                                               (*record_batch)->num_rows(),
+                                               std::move(columns));
+      return arrow::Status::OK();
+    }
+
+    // Reads one DuckDB chunk as a record batch.
+    arrow::Status
+    read_chunk(std::shared_ptr<arrow::RecordBatch> *record_batch)
+    {
+      PhaseTimer timer(profile_ ? &(profile_->fetch) : nullptr);
+      ARROW_RETURN_NOT_OK(read_chunk_internal(record_batch));
+      if (profile_ && *record_batch) {
+        profile_->n_batches++;
+        profile_->n_rows += (*record_batch)->num_rows();
+        profile_->n_bytes += arrow::util::TotalBufferSize(**record_batch);
+      }
+      return arrow::Status::OK();
+    }
+
+    arrow::Status
+    read_chunk_internal(std::shared_ptr<arrow::RecordBatch> *record_batch)
+    {
+      record_batch->reset();
+      if (table_reader_) {
+        return table_reader_->ReadNext(record_batch);
+      }
+      ArrowArray c_abi_array = {};
+      auto array = reinterpret_cast<duckdb_arrow_array>(&c_abi_array);
+      if (streaming_) {
+        // Scans may be started while fetching.
+        arrow_duckdb::QueryMemoryPoolScope memory_pool(*memory_pool_ref_,
+                                                       memory_pool_);
+        auto chunk = duckdb_stream_fetch_chunk(stream_);
+        if (!chunk) {
+          auto error = duckdb_result_error(&stream_);
+          if (error) {
+            return duckdb_error("Failed to fetch Apache Arrow array", error);
+          }
+          return arrow::Status::OK();
+        }
+        duckdb_result_arrow_array(stream_, chunk, &array);
+        duckdb_destroy_data_chunk(&chunk);
+      } else {
+        auto state = duckdb_query_arrow_array(arrow_, &array);
+        if (state == DuckDBError) {
+          return duckdb_error("Failed to fetch Apache Arrow array",
+                              arrow_error());
+        }
+      }
+      if (!c_abi_array.release) {
+        return arrow::Status::OK();
+      }
+      ARROW_ASSIGN_OR_RAISE(
+        *record_batch,
+        arrow_duckdb::import_tracked_record_batch(&c_abi_array,
+                                                  schema_,
+                                                  memory_pool_));
+      return arrow::Status::OK();
+    }
+
+    arrow::Status
+    concatenate_chunks(const arrow::RecordBatchVector &chunks,
+                       int64_t n_rows,
+                       std::shared_ptr<arrow::RecordBatch> *record_batch)
+    {
+      if (chunks.empty()) {
+        record_batch->reset();
+        return arrow::Status::OK();
+      }
+      if (chunks.size() == 1) {
+        *record_batch = chunks[0];
+        return arrow::Status::OK();
+      }
+      std::vector<std::shared_ptr<arrow::Array>> columns;
+      for (int i = 0; i < schema_->num_fields(); ++i) {
+        arrow::ArrayVector chunked_column;
+        for (const auto &chunk : chunks) {
+          chunked_column.push_back(chunk->column(i));
+        }
+        ARROW_ASSIGN_OR_RAISE(
+          auto column,
+          arrow::Concatenate(chunked_column, arrow_memory_pool()));
+        columns.push_back(std::move(column));
+      }
+      *record_batch = arrow::RecordBatch::Make(schema_, n_rows, columns);
+      return arrow::Status::OK();
+    }
+
+    const char *
+    arrow_error()
+    {
+      if (!arrow_) {
+        return nullptr;
+      }
+      return duckdb_query_arrow_error(arrow_);
+    }
+
+    arrow::Status
+    import_schema(ArrowSchema *c_abi_schema)
+    {
+      ARROW_ASSIGN_OR_RAISE(schema_, arrow::ImportSchema(c_abi_schema));
+      return update_output_schema();
+    }
+
+    arrow::Status
+    update_output_schema()
+    {
+      output_schema_ = schema_;
+      if (string_type_ != arrow_duckdb::StringType::DICTIONARY) {
+        return arrow::Status::OK();
+      }
+      auto dictionary_type = arrow::dictionary(arrow::int32(), arrow::utf8());
+      for (int i = 0; i < output_schema_->num_fields(); ++i) {
+        const auto &field = output_schema_->field(i);
+        if (field->type()->id() != arrow::Type::STRING) {
+          continue;
+        }
+        ARROW_ASSIGN_OR_RAISE(
+          output_schema_,
+          output_schema_->SetField(i, field->WithType(dictionary_type)));
+      }
+      return arrow::Status::OK();
+    }
+
+    arrow::Status
+    import_materialized_schema()
+    {
+      ArrowSchema c_abi_schema;
+      auto schema = reinterpret_cast<duckdb_arrow_schema>(&c_abi_schema);
+      auto state = duckdb_query_arrow_schema(arrow_, &schema);
+      if (state == DuckDBError) {
+        return duckdb_error("Failed to fetch Apache Arrow schema",
+                            arrow_error());
+      }
+      return import_schema(&c_abi_schema);
+    }
+  };
+
+  struct MemoryPool {
+    std::shared_ptr<arrow_duckdb::TrackingMemoryPool> pool;
+  };
+
+  void
+  memory_pool_free(void *data)
+  {
+    delete static_cast<MemoryPool *>(data);
+  }
+
+  static const rb_data_type_t memory_pool_type = {
+    "ArrowDuckDB::MemoryPool",
+    {
+      nullptr,
+      memory_pool_free,
+    },
+    nullptr,
+    nullptr,
+    RUBY_TYPED_FREE_IMMEDIATELY,
+  };
+
+  VALUE
+  memory_pool_alloc_func(VALUE klass)
+  {
+    return TypedData_Wrap_Struct(klass, &memory_pool_type, new MemoryPool());
+  }
+
+  const std::shared_ptr<arrow_duckdb::TrackingMemoryPool> &
+  memory_pool_get(VALUE self)
+  {
+    MemoryPool *data;
+    TypedData_Get_Struct(self, MemoryPool, &memory_pool_type, data);
+    if (!data->pool) {
+      rb_raise(rb_eArgError, "uninitialized memory pool: %" PRIsVALUE, self);
+    }
+    return data->pool;
+  }
+
+  VALUE
+  memory_pool_wrap(std::shared_ptr<arrow_duckdb::TrackingMemoryPool> pool)
+  {
+    auto rb_pool = rb_obj_alloc(cArrowDuckDBMemoryPool);
+    MemoryPool *data;
+    TypedData_Get_Struct(rb_pool, MemoryPool, &memory_pool_type, data);
+    data->pool = std::move(pool);
+    return rb_pool;
+  }
+
+  // ArrowDuckDB::MemoryPool.new(backend: nil, limit: nil)
+  //
+  // backend is :system, :jemalloc, :mimalloc or nil for Apache
+  // Arrow's default. limit is the max number of bytes or nil for no
+  // limit.
+  VALUE
+  memory_pool_initialize(int argc, VALUE *argv, VALUE self)
+  {
+    VALUE rb_options;
+    rb_scan_args(argc, argv, ":", &rb_options);
+    VALUE rb_backend = Qnil;
+    int64_t limit = -1;
+    if (!NIL_P(rb_options)) {
+      ID keywords[2];
+      CONST_ID(keywords[0], "backend");
+      CONST_ID(keywords[1], "limit");
+      VALUE values[2];
+      rb_get_kwargs(rb_options, keywords, 0, 2, values);
+      if (values[0] != Qundef && !NIL_P(values[0])) {
+        rb_backend = rb_String(values[0]);
+      }
+      if (values[1] != Qundef && !NIL_P(values[1])) {
+        limit = NUM2LL(values[1]);
+        if (limit < 0) {
+          rb_raise(rb_eArgError,
+                   "limit must not be negative: %" PRIsVALUE,
+                   values[1]);
+        }
+      }
+    }
+
+    arrow::MemoryPool *backend_pool = nullptr;
+    arrow::Status status;
+    // C++ objects must be destroyed before raising.
+    {
+      std::string backend;
+      if (!NIL_P(rb_backend)) {
+        backend = std::string(RSTRING_PTR(rb_backend), RSTRING_LEN(rb_backend));
+      }
+      auto backend_pool_result = arrow_duckdb::backend_memory_pool(backend);
+      if (backend_pool_result.ok()) {
+        backend_pool = *backend_pool_result;
+      } else {
+        status = backend_pool_result.status();
+      }
+    }
+    check_status(status, "[arrow-duckdb][memory-pool][new]");
+    MemoryPool *data;
+    TypedData_Get_Struct(self, MemoryPool, &memory_pool_type, data);
+    data->pool =
+      std::make_shared<arrow_duckdb::TrackingMemoryPool>(backend_pool, limit);
+    return Qnil;
+  }
+
+  VALUE
+  memory_pool_bytes_allocated(VALUE self)
+  {
+    return LL2NUM(memory_pool_get(self)->bytes_allocated());
+  }
+
+  VALUE
+  memory_pool_max_memory(VALUE self)
+  {
+    return LL2NUM(memory_pool_get(self)->max_memory());
+  }
+
+  VALUE
+  memory_pool_total_bytes_allocated(VALUE self)
+  {
+    return LL2NUM(memory_pool_get(self)->total_bytes_allocated());
+  }
+
+  VALUE
+  memory_pool_n_allocations(VALUE self)
+  {
+    return LL2NUM(memory_pool_get(self)->num_allocations());
+  }
+
+  VALUE
+  memory_pool_backend_name(VALUE self)
+  {
+    auto backend_name = memory_pool_get(self)->backend_name();
+    return rb_utf8_str_new(backend_name.data(), backend_name.size());
+  }
+
+  VALUE
+  memory_pool_limit(VALUE self)
+  {
+    auto limit = memory_pool_get(self)->limit();
+    if (limit < 0) {
+      return Qnil;
+    }
+    return LL2NUM(limit);
+  }
+
+  VALUE
+  memory_pool_set_limit(VALUE self, VALUE rb_limit)
+  {
+    int64_t limit = -1;
+    if (!NIL_P(rb_limit)) {
+      limit = NUM2LL(rb_limit);
+      if (limit < 0) {
+        rb_raise(rb_eArgError,
+                 "limit must not be negative: %" PRIsVALUE,
+                 rb_limit);
+      }
+    }
+    memory_pool_get(self)->set_limit(limit);
+    return rb_limit;
+  }
+
+  VALUE
+  connection_set_arrow_memory_pool(VALUE self, VALUE rb_pool)
+  {
+    auto ctx = get_struct_connection(self);
+    if (!(ctx->con)) {
+      rb_raise(eDuckDBError, "Database connection closed");
+    }
+
+    std::shared_ptr<arrow_duckdb::TrackingMemoryPool> pool;
+    if (!NIL_P(rb_pool)) {
+      pool = memory_pool_get(rb_pool);
+    }
+    arrow::Status status;
+    try {
+      arrow_duckdb::connection_set_memory_pool(ctx->con, pool);
+    } catch (const std::exception &error) {
+      status = duckdb_error("Failed to set memory pool", error.what());
+    }
+    check_status(status, "[arrow-duckdb][connection][memory-pool]");
+    rb_iv_set(self, "@arrow_memory_pool", rb_pool);
+    return rb_pool;
+  }
+
+  // Scans of registered Apache Arrow data by queries of this
+  // connection and results of this connection allocate from the
+  // returned memory pool. It's created with Apache Arrow's default
+  // backend on the first call.
+  VALUE
+  connection_get_arrow_memory_pool(VALUE self)
+  {
+    auto rb_pool = rb_iv_get(self, "@arrow_memory_pool");
+    if (NIL_P(rb_pool)) {
+      rb_pool = rb_class_new_instance(0, nullptr, cArrowDuckDBMemoryPool);
+      connection_set_arrow_memory_pool(self, rb_pool);
+    }
+    return rb_pool;
+  }
+
+  // Scan statistics of a registered Apache Arrow data before a
+  // query. The registration is scanned by the query when its last
+  // scan statistics is changed.
+  struct ScanSnapshot {
+    std::string name;
+    std::shared_ptr<arrow_duckdb::Registration> registration;
+    std::shared_ptr<arrow_duckdb::ScanStatistics> statistics;
+  };
+
+  struct Result {
+    std::shared_ptr<ResultReader> reader;
+    GArrowSchema *gschema = nullptr;
+    VALUE connection = Qnil;
+    VALUE rb_prepared_statement = Qnil;
+    // Only for profile.
+    std::vector<ScanSnapshot> scans;
+  };
+
+  void
+  result_snapshot_scans(Result *result);
+
+  void
+  result_mark(void *data)
+  {
+    Result *result = static_cast<Result *>(data);
+    rb_gc_mark(result->connection);
+    rb_gc_mark(result->rb_prepared_statement);
+  }
+
+  void
+  result_free(void *data)
+  {
+    Result *result = static_cast<Result *>(data);
+    if (result->gschema) {
+      g_object_unref(result->gschema);
+    }
+    delete result;
+  }
+
+  static const rb_data_type_t result_type = {
+    "ArrowDuckDB::Result",
+    {
+      result_mark,
+      result_free,
+    },
+    nullptr,
+    nullptr,
+    RUBY_TYPED_FREE_IMMEDIATELY,
+  };
+
+  VALUE
+  result_alloc_func(VALUE klass)
+  {
+    return TypedData_Wrap_Struct(klass, &result_type, new Result());
+  }
+
+  Result *
+  result_get(VALUE self)
+  {
+    Result *result;
+    TypedData_Get_Struct(self, Result, &result_type, result);
+    if (!result->reader) {
+      rb_raise(rb_eArgError, "uninitialized result: %" PRIsVALUE, self);
+    }
+    return result;
+  }
+
+  VALUE
+  result_new(VALUE connection, const QueryOptions &options)
+  {
+    ID id_new;
+    CONST_ID(id_new, "new");
+    auto rb_result = rb_funcall(cArrowDuckDBResult, id_new, 0);
+    Result *result;
+    TypedData_Get_Struct(rb_result, Result, &result_type, result);
+    result->reader = std::make_shared<ResultReader>(options.batch_size);
+    result->reader->set_string_type(options.strings);
+    if (!NIL_P(connection) && get_struct_connection(connection)->con) {
+      // Each result has its own pool to count its memory and apply
+      // memory_limit:. The pool of the connection also counts it.
+      auto connection_pool =
+        memory_pool_get(connection_get_arrow_memory_pool(connection));
+      result->reader->set_memory_pool(
+        std::make_shared<arrow_duckdb::TrackingMemoryPool>(
+          connection_pool,
+          options.memory_limit));
+    }
+    result->connection = connection;
+    if (options.profile) {
+      result->reader->enable_profile();
+      result_snapshot_scans(result);
+    }
+    return rb_result;
+  }
+
+  // Returns a result that reads record batches of table. This is for
+  // cached results. So the data aren't copied.
+  VALUE
+  result_s_from_table(VALUE klass, VALUE rb_table)
+  {
+    if (!RVAL2CBOOL(rb_obj_is_kind_of(rb_table, cArrowTable))) {
+      rb_raise(rb_eArgError, "must be Arrow::Table: %" PRIsVALUE, rb_table);
+    }
+    auto table = garrow_table_get_raw(GARROW_TABLE(RVAL2GOBJ(rb_table)));
+    ID id_new;
+    CONST_ID(id_new, "new");
+    auto rb_result = rb_funcall(klass, id_new, 0);
+    Result *result;
+    TypedData_Get_Struct(rb_result, Result, &result_type, result);
+    result->reader = std::make_shared<ResultReader>(0);
+    result->reader->read_table(table);
+    return rb_result;
+  }
+
+  // The number of bytes of all buffers of table. Shared buffers are
+  // counted once.
+  VALUE
+  result_cache_table_n_bytes(VALUE self, VALUE rb_table)
+  {
+    if (!RVAL2CBOOL(rb_obj_is_kind_of(rb_table, cArrowTable))) {
+      rb_raise(rb_eArgError, "must be Arrow::Table: %" PRIsVALUE, rb_table);
+    }
+    auto table = garrow_table_get_raw(GARROW_TABLE(RVAL2GOBJ(rb_table)));
+    return LL2NUM(arrow::util::TotalBufferSize(*table));
+  }
+
+  VALUE
+  result_fetch_internal(Result *result)
+  {
+    std::shared_ptr<arrow::RecordBatch> record_batch;
+    arrow::Status status;
+    call_without_gvl(connection_get_raw(result->connection), [&]() {
+      status = result->reader->ReadNext(&record_batch);
+    });
+    check_status(status, "[arrow-duckdb][result][fetch]");
+    if (!record_batch) {
+      return Qnil;
+    }
+    return GOBJ2RVAL_UNREF(garrow_record_batch_new_raw(&record_batch));
+  }
+
+  VALUE
+  result_fetch(VALUE self)
+  {
+    auto result = result_get(self);
+    return result_fetch_internal(result);
+  }
+
+  VALUE
+  result_each(VALUE self)
+  {
+    RETURN_ENUMERATOR(self, 0, 0);
+
+    auto result = result_get(self);
+    while (true) {
+      auto record_batch = result_fetch_internal(result);
+      if (NIL_P(record_batch)) {
+        break;
+      }
+      rb_yield(record_batch);
+    }
+
+    return self;
+  }
+
+  VALUE
+  result_schema(VALUE self)
+  {
+    auto result = result_get(self);
+    if (!result->gschema) {
+      auto schema = result->reader->schema();
+      result->gschema = garrow_schema_new_raw(&schema);
+    }
+    return GOBJ2RVAL(result->gschema);
+  }
+
+  VALUE
+  result_n_columns(VALUE self)
+  {
+    auto result = result_get(self);
+    return ULL2NUM(result->reader->n_columns());
+  }
+
+  VALUE
+  result_n_rows(VALUE self)
+  {
+    auto result = result_get(self);
+    if (result->reader->is_streaming()) {
+      // We can't know the number of rows until we fetch all chunks.
+      return Qnil;
+    }
+    return ULL2NUM(result->reader->n_rows());
+  }
+
+  VALUE
+  result_n_changed_rows(VALUE self)
+  {
+    auto result = result_get(self);
+    return ULL2NUM(result->reader->n_changed_rows());
+  }
+
+  arrow::Result<std::shared_ptr<arrow::Table>>
+  result_read_table(Result *result, bool combine_chunks)
+  {
+    ARROW_ASSIGN_OR_RAISE(auto table, result->reader->ToTable());
+    if (combine_chunks) {
+      return table->CombineChunks();
+    } else {
+      return table;
+    }
+  }
+
+  VALUE
+  result_to_table(int argc, VALUE *argv, VALUE self)
+  {
+    VALUE rb_options;
+    rb_scan_args(argc, argv, ":", &rb_options);
+    bool combine_chunks = false;
+    if (!NIL_P(rb_options)) {
+      ID keywords[1];
+      CONST_ID(keywords[0], "combine_chunks");
+      VALUE values[1];
+      rb_get_kwargs(rb_options, keywords, 0, 1, values);
+      if (values[0] != Qundef) {
+        combine_chunks = RVAL2CBOOL(values[0]);
+      }
+    }
+
+    auto result = result_get(self);
+    std::shared_ptr<arrow::Table> table;
+    arrow::Status status;
+    call_without_gvl(connection_get_raw(result->connection), [&]() {
+      auto table_result = result_read_table(result, combine_chunks);
+      if (table_result.ok()) {
+        table = *table_result;
+      } else {
+        status = table_result.status();
+      }
+    });
+    check_status(status, "[arrow-duckdb][result][to-table]");
+    return GOBJ2RVAL_UNREF(garrow_table_new_raw(&table));
+  }
+
+  VALUE
+  result_write_parquet(int argc, VALUE *argv, VALUE self)
+  {
+    VALUE path;
+    VALUE rb_options;
+    rb_scan_args(argc, argv, "1:", &path, &rb_options);
+    int64_t row_group_size = 0;
+    VALUE rb_compression = Qnil;
+    if (!NIL_P(rb_options)) {
+      ID keywords[2];
+      CONST_ID(keywords[0], "row_group_size");
+      CONST_ID(keywords[1], "compression");
+      VALUE values[2];
+      rb_get_kwargs(rb_options, keywords, 0, 2, values);
+      if (values[0] != Qundef && !NIL_P(values[0])) {
+        row_group_size = NUM2LL(values[0]);
+        if (row_group_size <= 0) {
+          rb_raise(rb_eArgError,
+                   "row_group_size must be positive: %" PRIsVALUE,
+                   values[0]);
+        }
+      }
+      if (values[1] != Qundef && !NIL_P(values[1])) {
+        rb_compression = rb_String(values[1]);
+      }
+    }
+
+    auto result = result_get(self);
+    path = rb_str_new_frozen(rb_get_path(path));
+    int64_t n_rows = 0;
+    arrow::Status status;
+    // C++ objects must be destroyed before raising.
+    {
+      std::string c_path(RSTRING_PTR(path), RSTRING_LEN(path));
+      arrow_duckdb::ParquetWriteOptions options;
+      options.row_group_size = row_group_size;
+      if (!NIL_P(rb_compression)) {
+        options.compression =
+          std::string(RSTRING_PTR(rb_compression),
+                      RSTRING_LEN(rb_compression));
+      }
+      call_without_gvl(connection_get_raw(result->connection), [&]() {
+        // Buffers for writing are counted by the pool of the query.
+        auto memory_pool = result->reader->memory_pool();
+        auto n_rows_result = arrow_duckdb::write_parquet(
+          result->reader.get(),
+          c_path,
+          options,
+          memory_pool ? memory_pool.get() : arrow::default_memory_pool());
+        if (n_rows_result.ok()) {
+          n_rows = *n_rows_result;
+        } else {
+          status = n_rows_result.status();
+        }
+      });
+    }
+    check_status(status, "[arrow-duckdb][result][write-parquet]");
+    return LL2NUM(n_rows);
+  }
+
+  VALUE
+  result_write_ipc(int argc, VALUE *argv, VALUE self)
+  {
+    VALUE path;
+    VALUE rb_options;
+    rb_scan_args(argc, argv, "1:", &path, &rb_options);
+    VALUE rb_compression = Qnil;
+    if (!NIL_P(rb_options)) {
+      ID keywords[1];
+      CONST_ID(keywords[0], "compression");
+      VALUE values[1];
+      rb_get_kwargs(rb_options, keywords, 0, 1, values);
+      if (values[0] != Qundef && !NIL_P(values[0])) {
+        rb_compression = rb_String(values[0]);
+      }
+    }
+
+    auto result = result_get(self);
+    path = rb_str_new_frozen(rb_get_path(path));
+    int64_t n_rows = 0;
+    arrow::Status status;
+    // C++ objects must be destroyed before raising.
+    {
+      std::string c_path(RSTRING_PTR(path), RSTRING_LEN(path));
+      std::string compression;
+      if (!NIL_P(rb_compression)) {
+        compression = std::string(RSTRING_PTR(rb_compression),
+                                  RSTRING_LEN(rb_compression));
+      }
+      call_without_gvl(connection_get_raw(result->connection), [&]() {
+        auto memory_pool = result->reader->memory_pool();
+        auto n_rows_result = arrow_duckdb::write_ipc(
+          result->reader.get(),
+          c_path,
+          compression,
+          memory_pool ? memory_pool.get() : arrow::default_memory_pool());
+        if (n_rows_result.ok()) {
+          n_rows = *n_rows_result;
+        } else {
+          status = n_rows_result.status();
+        }
+      });
+    }
+    check_status(status, "[arrow-duckdb][result][write-ipc]");
+    return LL2NUM(n_rows);
+  }
+
+  VALUE
+  result_to_record_batch_reader(VALUE self)
+  {
+    auto result = result_get(self);
+    std::shared_ptr<arrow::RecordBatchReader> reader = result->reader;
+    return GOBJ2RVAL_UNREF(garrow_record_batch_reader_new_raw(&reader,
+                                                              nullptr));
+  }
+
+  VALUE
+  query_sql_arrow(int argc, VALUE *argv, VALUE self)
+  {
+    VALUE sql;
+    VALUE rb_options;
+    rb_scan_args(argc, argv, "1:", &sql, &rb_options);
+    QueryOptions options;
+    query_options_parse(rb_options, &options);
+
+    auto ctx = get_struct_connection(self);
+
+    if (!(ctx->con)) {
+      rb_raise(eDuckDBError, "Database connection closed");
+    }
+
+    auto result = result_new(self, options);
+    auto reader = result_get(result)->reader.get();
+    // Other threads may change sql while we release the GVL.
+    sql = rb_str_new_frozen(sql);
+    auto c_sql = StringValueCStr(sql);
+    arrow::Status status;
+    call_without_gvl(ctx->con, [&]() {
+      if (options.stream) {
+        status = reader->query_streaming(ctx->con, c_sql);
+      } else {
+        status = reader->query(ctx->con, c_sql);
+      }
+    });
+    RB_GC_GUARD(sql);
+    check_status(status, "[arrow-duckdb][query]");
+
+    return result;
+  }
+
+  void
+  check_arrow_source(VALUE arrow_source)
+  {
+    if (!RVAL2CBOOL(rb_obj_is_kind_of(arrow_source, cArrowTable)) &&
+        !RVAL2CBOOL(rb_obj_is_kind_of(arrow_source, cArrowRecordBatchReader)) &&
+        !RVAL2CBOOL(rb_obj_is_kind_of(arrow_source, cArrowDatasetDataset))) {
+      rb_raise(rb_eArgError,
+               "must be Arrow::Table, Arrow::RecordBatchReader or "
+               "ArrowDataset::Dataset: %" PRIsVALUE,
+               arrow_source);
+    }
+  }
+
+  struct Registration {
+    std::shared_ptr<arrow_duckdb::Registration> registration;
+    VALUE source = Qnil;
+  };
+
+  void
+  registration_mark(void *data)
+  {
+    rb_gc_mark(static_cast<Registration *>(data)->source);
+  }
+
+  void
+  registration_free(void *data)
+  {
+    delete static_cast<Registration *>(data);
+  }
+
+  static const rb_data_type_t registration_type = {
+    "ArrowDuckDB::Registration",
+    {
+      registration_mark,
+      registration_free,
+    },
+    nullptr,
+    nullptr,
+    RUBY_TYPED_FREE_IMMEDIATELY,
+  };
+
+  VALUE
+  registration_alloc_func(VALUE klass)
+  {
+    return TypedData_Wrap_Struct(klass, &registration_type, new Registration());
+  }
+
+  VALUE
+  registration_new(std::shared_ptr<arrow_duckdb::Registration> registration,
+                   VALUE source)
+  {
+    auto rb_registration = registration_alloc_func(cArrowDuckDBRegistration);
+    Registration *data;
+    TypedData_Get_Struct(rb_registration,
+                         Registration,
+                         &registration_type,
+                         data);
+    data->registration = std::move(registration);
+    data->source = source;
+    return rb_registration;
+  }
+
+  VALUE
+  query_arrow_scan_statistics(VALUE self, VALUE name)
+  {
+    auto arrow_tables = rb_iv_get(self, "@arrow_tables");
+    if (NIL_P(arrow_tables)) {
+      return Qnil;
+    }
+    auto rb_registration = rb_hash_lookup(arrow_tables, name);
+    if (NIL_P(rb_registration)) {
+      return Qnil;
+    }
+    Registration *data;
+    TypedData_Get_Struct(rb_registration,
+                         Registration,
+                         &registration_type,
+                         data);
+    auto statistics = data->registration->last_scan_statistics();
+    if (!statistics) {
+      return Qnil;
+    }
+    auto rb_pushed_filters = rb_ary_new();
+    for (const auto &filter : statistics->pushed_filters) {
+      rb_ary_push(rb_pushed_filters,
+                  rb_utf8_str_new(filter.data(), filter.size()));
+    }
+    auto rb_retained_filters = rb_ary_new();
+    for (const auto &filter : statistics->retained_filters) {
+      rb_ary_push(rb_retained_filters,
+                  rb_utf8_str_new(filter.data(), filter.size()));
+    }
+    auto rb_statistics = rb_hash_new();
+    rb_hash_aset(rb_statistics,
+                 ID2SYM(rb_intern("pushed_filters")),
+                 rb_pushed_filters);
+    rb_hash_aset(rb_statistics,
+                 ID2SYM(rb_intern("retained_filters")),
+                 rb_retained_filters);
+    rb_hash_aset(rb_statistics,
+                 ID2SYM(rb_intern("n_batches")),
+                 LL2NUM(statistics->n_batches.load()));
+    rb_hash_aset(rb_statistics,
+                 ID2SYM(rb_intern("n_rows")),
+                 LL2NUM(statistics->n_rows.load()));
+    return rb_statistics;
+  }
+
+  struct BindRecordData {
+    VALUE self;
+    arrow_duckdb::BindRecorder *bind_recorder;
+    VALUE names;
+  };
+
+  int
+  record_bound_arrow_names_foreach(VALUE name,
+                                   VALUE rb_registration,
+                                   VALUE user_data)
+  {
+    auto data = reinterpret_cast<BindRecordData *>(user_data);
+    Registration *registration_data;
+    TypedData_Get_Struct(rb_registration,
+                         Registration,
+                         &registration_type,
+                         registration_data);
+    for (auto registration : data->bind_recorder->registrations()) {
+      if (registration == registration_data->registration.get()) {
+        rb_ary_push(data->names, rb_String(name));
+        break;
+      }
+    }
+    return ST_CONTINUE;
+  }
+
+  VALUE
+  record_bound_arrow_names_body(VALUE user_data)
+  {
+    auto data = reinterpret_cast<BindRecordData *>(user_data);
+    rb_yield(Qnil);
+    data->names = rb_ary_new();
+    auto arrow_tables = rb_iv_get(data->self, "@arrow_tables");
+    if (!NIL_P(arrow_tables)) {
+      rb_hash_foreach(arrow_tables,
+                      record_bound_arrow_names_foreach,
+                      user_data);
+    }
+    for (const auto &name : data->bind_recorder->names()) {
+      auto rb_name = rb_utf8_str_new(name.data(), name.size());
+      if (!RTEST(rb_ary_includes(data->names, rb_name))) {
+        rb_ary_push(data->names, rb_name);
+      }
+    }
+    return data->names;
+  }
+
+  VALUE
+  record_bound_arrow_names_ensure(VALUE user_data)
+  {
+    auto data = reinterpret_cast<BindRecordData *>(user_data);
+    delete data->bind_recorder;
+    return Qnil;
+  }
+
+  // Yields and returns names of registered Apache Arrow data bound
+  // by queries in the block. They are bound even when they aren't
+  // scanned such as "LIMIT 0" queries. ArrowDuckDB::ResultCache uses
+  // them to invalidate cached results.
+  VALUE
+  query_record_bound_arrow_names(VALUE self)
+  {
+    auto ctx = get_struct_connection(self);
+
+    if (!(ctx->con)) {
+      rb_raise(eDuckDBError, "Database connection closed");
+    }
+
+    BindRecordData data{
+      self,
+      new arrow_duckdb::BindRecorder(ctx->con),
+      Qnil,
+    };
+    return rb_ensure(record_bound_arrow_names_body,
+                     reinterpret_cast<VALUE>(&data),
+                     record_bound_arrow_names_ensure,
+                     reinterpret_cast<VALUE>(&data));
+  }
+
+  int
+  result_snapshot_scans_foreach(VALUE name, VALUE rb_registration, VALUE data)
+  {
+    auto result = reinterpret_cast<Result *>(data);
+    Registration *registration_data;
+    TypedData_Get_Struct(rb_registration,
+                         Registration,
+                         &registration_type,
+                         registration_data);
+    auto &registration = registration_data->registration;
+    name = rb_String(name);
+    result->scans.push_back({
+        std::string(RSTRING_PTR(name), RSTRING_LEN(name)),
+        registration,
+        registration->last_scan_statistics(),
+      });
+    return ST_CONTINUE;
+  }
+
+  void
+  result_snapshot_scans(Result *result)
+  {
+    auto arrow_tables = rb_iv_get(result->connection, "@arrow_tables");
+    if (NIL_P(arrow_tables)) {
+      return;
+    }
+    rb_hash_foreach(arrow_tables,
+                    result_snapshot_scans_foreach,
+                    reinterpret_cast<VALUE>(result));
+  }
+
+  VALUE
+  phase_profile_to_ruby(const PhaseProfile &phase)
+  {
+    auto rb_phase = rb_hash_new();
+    rb_hash_aset(rb_phase,
+                 ID2SYM(rb_intern("wall_time")),
+                 DBL2NUM(phase.wall_time_ns / 1e9));
+    rb_hash_aset(rb_phase,
+                 ID2SYM(rb_intern("cpu_time")),
+                 DBL2NUM(phase.cpu_time_ns / 1e9));
+    return rb_phase;
+  }
+
+  // The memory pool for this result. It counts scans of registered
+  // Apache Arrow data by this query and fetched record batches. nil
+  // for a cached result.
+  VALUE
+  result_memory_pool(VALUE self)
+  {
+    auto result = result_get(self);
+    const auto &pool = result->reader->memory_pool();
+    if (!pool) {
+      return Qnil;
+    }
+    return memory_pool_wrap(pool);
+  }
+
+  // Returns nil when profile isn't enabled by the profile: option.
+  VALUE
+  result_profile(VALUE self)
+  {
+    auto result = result_get(self);
+    const auto &profile = result->reader->profile();
+    if (!profile) {
+      return Qnil;
+    }
+
+    auto rb_profile = rb_hash_new();
+    rb_hash_aset(rb_profile,
+                 ID2SYM(rb_intern("execute")),
+                 phase_profile_to_ruby(profile->execute));
+    auto rb_fetch = phase_profile_to_ruby(profile->fetch);
+    rb_hash_aset(rb_fetch,
+                 ID2SYM(rb_intern("n_batches")),
+                 LL2NUM(profile->n_batches));
+    rb_hash_aset(rb_fetch,
+                 ID2SYM(rb_intern("n_rows")),
+                 LL2NUM(profile->n_rows));
+    rb_hash_aset(rb_fetch,
+                 ID2SYM(rb_intern("n_bytes")),
+                 LL2NUM(profile->n_bytes));
+    rb_hash_aset(rb_profile, ID2SYM(rb_intern("fetch")), rb_fetch);
+
+    auto rb_scans = rb_hash_new();
+    for (const auto &scan : result->scans) {
+      auto statistics = scan.registration->last_scan_statistics();
+      if (!statistics || statistics == scan.statistics) {
+        continue;
+      }
+      auto rb_scan = rb_hash_new();
+      rb_hash_aset(rb_scan,
+                   ID2SYM(rb_intern("n_batches")),
+                   LL2NUM(statistics->n_batches.load()));
+      rb_hash_aset(rb_scan,
+                   ID2SYM(rb_intern("n_rows")),
+                   LL2NUM(statistics->n_rows.load()));
+      auto n_removed_rows = statistics->n_removed_rows.load();
+      rb_hash_aset(rb_scan,
+                   ID2SYM(rb_intern("n_removed_rows")),
+                   n_removed_rows < 0 ? Qnil : LL2NUM(n_removed_rows));
+      rb_hash_aset(rb_scan,
+                   ID2SYM(rb_intern("wall_time")),
+                   DBL2NUM(statistics->scan_time_ns.load() / 1e9));
+      rb_hash_aset(rb_scans,
+                   rb_utf8_str_new(scan.name.data(), scan.name.size()),
+                   rb_scan);
+    }
+    rb_hash_aset(rb_profile, ID2SYM(rb_intern("scans")), rb_scans);
+
+    if (profile->duckdb.empty()) {
+      rb_hash_aset(rb_profile, ID2SYM(rb_intern("duckdb")), Qnil);
+    } else {
+      rb_hash_aset(rb_profile,
+                   ID2SYM(rb_intern("duckdb")),
+                   rb_utf8_str_new(profile->duckdb.data(),
+                                   profile->duckdb.size()));
+    }
+    return rb_profile;
+  }
+
+  VALUE
+  query_unregister_arrow(VALUE self, VALUE name)
+  {
+    auto ctx = get_struct_connection(self);
+
+    if (!(ctx->con)) {
+      rb_raise(eDuckDBError, "Database connection closed");
+    }
+
+    arrow_duckdb::connection_unregister(ctx->con, name);
+
+    auto arrow_tables = rb_iv_get(self, "@arrow_tables");
+    if (NIL_P(arrow_tables)) {
+      arrow_tables = rb_hash_new();
+      rb_iv_set(self, "@arrow_tables", arrow_tables);
+    }
+    rb_hash_delete(arrow_tables, name);
+
+    return self;
+  }
+
+  VALUE
+  query_register_arrow_body(VALUE)
+  {
+    return rb_yield_values(0);
+  }
+
+  struct QueryRegisterArrowData {
+    VALUE self;
+    VALUE name;
+  };
+
+  VALUE
+  query_register_arrow_ensure(VALUE user_data)
+  {
+    auto data = reinterpret_cast<QueryRegisterArrowData *>(user_data);
+    return query_unregister_arrow(data->self, data->name);
+  }
+
+  VALUE
+  query_register_arrow(int argc, VALUE *argv, VALUE self)
+  {
+    VALUE name;
+    VALUE arrow_table;
+    VALUE rb_options;
+    rb_scan_args(argc, argv, "2:", &name, &arrow_table, &rb_options);
+    bool statistics = false;
+    if (!NIL_P(rb_options)) {
+      ID keywords[1];
+      CONST_ID(keywords[0], "statistics");
+      VALUE values[1];
+      rb_get_kwargs(rb_options, keywords, 0, 1, values);
+      if (values[0] != Qundef) {
+        statistics = RVAL2CBOOL(values[0]);
+      }
+    }
+
+    auto ctx = get_struct_connection(self);
+
+    if (!(ctx->con)) {
+      rb_raise(eDuckDBError, "Database connection closed");
+    }
+
+    check_arrow_source(arrow_table);
+
+    auto registration =
+      registration_new(arrow_duckdb::connection_register(ctx->con,
+                                                         name,
+                                                         arrow_table,
+                                                         statistics),
+                       arrow_table);
+
+    auto arrow_tables = rb_iv_get(self, "@arrow_tables");
+    if (NIL_P(arrow_tables)) {
+      arrow_tables = rb_hash_new();
+      rb_iv_set(self, "@arrow_tables", arrow_tables);
+    }
+    rb_hash_aset(arrow_tables, name, registration);
+
+    if (rb_block_given_p()) {
+      QueryRegisterArrowData data;
+      data.self = self;
+      data.name = name;
+      return rb_ensure(query_register_arrow_body,
+                       Qnil,
+                       query_register_arrow_ensure,
+                       reinterpret_cast<VALUE>(&data));
+    } else {
+      return self;
+    }
+  }
+
+  VALUE
+  query_insert_arrow(int argc, VALUE *argv, VALUE self)
+  {
+    VALUE table_name;
+    VALUE arrow_source;
+    VALUE rb_options;
+    rb_scan_args(argc, argv, "2:", &table_name, &arrow_source, &rb_options);
+    bool create = true;
+    if (!NIL_P(rb_options)) {
+      ID keywords[1];
+      CONST_ID(keywords[0], "create");
+      VALUE values[1];
+      rb_get_kwargs(rb_options, keywords, 0, 1, values);
+      if (values[0] != Qundef) {
+        create = RVAL2CBOOL(values[0]);
+      }
+    }
+
+    auto ctx = get_struct_connection(self);
+
+    if (!(ctx->con)) {
+      rb_raise(eDuckDBError, "Database connection closed");
+    }
+
+    check_arrow_source(arrow_source);
+
+    // Other threads may change table_name while we release the GVL.
+    StringValue(table_name);
+    table_name = rb_str_new_frozen(table_name);
+    auto c_table_name = StringValueCStr(table_name);
+    auto source = G_OBJECT(RVAL2GOBJ(arrow_source));
+    int64_t n_rows = 0;
+    arrow::Status status;
+    call_without_gvl(ctx->con, [&]() {
+      try {
+        n_rows = arrow_duckdb::connection_insert(ctx->con,
+                                                 c_table_name,
+                                                 source,
+                                                 create);
+      } catch (const std::exception &error) {
+        status = duckdb_error("Failed to insert Apache Arrow data",
+                              error.what());
+      }
+    });
+    RB_GC_GUARD(table_name);
+    RB_GC_GUARD(arrow_source);
+    check_status(status, "[arrow-duckdb][insert]");
+
+    return LL2NUM(n_rows);
+  }
+
+  struct RecordBatchQueue {
+    std::shared_ptr<arrow_duckdb::RecordBatchQueue> queue;
+  };
+
+  void
+  record_batch_queue_free(void *data)
+  {
+    delete static_cast<RecordBatchQueue *>(data);
+  }
+
+  static const rb_data_type_t record_batch_queue_type = {
+    "ArrowDuckDB::RecordBatchQueue",
+    {
+      nullptr,
+      record_batch_queue_free,
+    },
+    nullptr,
+    nullptr,
+    RUBY_TYPED_FREE_IMMEDIATELY,
+  };
+
+  VALUE
+  record_batch_queue_alloc_func(VALUE klass)
+  {
+    return TypedData_Wrap_Struct(klass,
+                                 &record_batch_queue_type,
+                                 new RecordBatchQueue());
+  }
+
+  arrow_duckdb::RecordBatchQueue *
+  record_batch_queue_get(VALUE self)
+  {
+    RecordBatchQueue *data;
+    TypedData_Get_Struct(self, RecordBatchQueue, &record_batch_queue_type, data);
+    if (!data->queue) {
+      rb_raise(rb_eArgError, "uninitialized queue: %" PRIsVALUE, self);
+    }
+    return data->queue.get();
+  }
+
+  void
+  record_batch_queue_interrupt(void *user_data)
+  {
+    auto queue = static_cast<arrow_duckdb::RecordBatchQueue *>(user_data);
+    queue->close(
+      arrow::Status::Cancelled("[arrow-duckdb][record-batch-queue] interrupted"));
+  }
+
+  // Runs function without the GVL. Thread#raise, Thread#kill and so
+  // on close the queue to wake up the waiting function.
+  template <typename Function>
+  void
+  record_batch_queue_call_without_gvl(arrow_duckdb::RecordBatchQueue *queue,
+                                      Function function)
+  {
+    rb_thread_call_without_gvl(without_gvl_body<Function>,
+                               &function,
+                               record_batch_queue_interrupt,
+                               queue);
+  }
+
+  VALUE
+  record_batch_queue_initialize(int argc, VALUE *argv, VALUE self)
+  {
+    VALUE rb_schema;
+    VALUE rb_capacity;
+    rb_scan_args(argc, argv, "02", &rb_schema, &rb_capacity);
+
+    size_t capacity = 4;
+    if (!NIL_P(rb_capacity)) {
+      auto n = NUM2LL(rb_capacity);
+      if (n <= 0) {
+        rb_raise(rb_eArgError,
+                 "capacity must be positive: %" PRIsVALUE,
+                 rb_capacity);
+      }
+      capacity = static_cast<size_t>(n);
+    }
+    GArrowSchema *gschema = nullptr;
+    if (!NIL_P(rb_schema)) {
+      gschema = GARROW_SCHEMA(RVAL2GOBJ(rb_schema));
+    }
+
+    RecordBatchQueue *data;
+    TypedData_Get_Struct(self, RecordBatchQueue, &record_batch_queue_type, data);
+    std::shared_ptr<arrow::Schema> schema;
+    if (gschema) {
+      schema = garrow_schema_get_raw(gschema);
+    }
+    data->queue =
+      std::make_shared<arrow_duckdb::RecordBatchQueue>(schema, capacity);
+    return Qnil;
+  }
+
+  VALUE
+  record_batch_queue_push(VALUE self, VALUE rb_record_batch)
+  {
+    auto queue = record_batch_queue_get(self);
+    auto grecord_batch = GARROW_RECORD_BATCH(RVAL2GOBJ(rb_record_batch));
+    bool pushed = false;
+    arrow::Status status;
+    record_batch_queue_call_without_gvl(queue, [&]() {
+      auto result = queue->push(garrow_record_batch_get_raw(grecord_batch));
+      if (result.ok()) {
+        pushed = *result;
+      } else {
+        status = result.status();
+      }
+    });
+    check_status(status, "[arrow-duckdb][record-batch-queue][push]");
+    return pushed ? Qtrue : Qfalse;
+  }
+
+  VALUE
+  record_batch_queue_close(int argc, VALUE *argv, VALUE self)
+  {
+    VALUE rb_message;
+    rb_scan_args(argc, argv, "01", &rb_message);
+
+    auto queue = record_batch_queue_get(self);
+    if (NIL_P(rb_message)) {
+      queue->close(arrow::Status::OK());
+    } else {
+      queue->close(
+        arrow::Status::IOError("[arrow-duckdb][record-batch-queue] ",
+                               StringValueCStr(rb_message)));
+    }
+    return self;
+  }
+
+  VALUE
+  record_batch_queue_reader(VALUE self)
+  {
+    auto queue = record_batch_queue_get(self);
+    arrow::Status status;
+    record_batch_queue_call_without_gvl(queue, [&]() {
+      status = queue->wait_schema().status();
+    });
+    check_status(status, "[arrow-duckdb][record-batch-queue][reader]");
+
+    RecordBatchQueue *data;
+    TypedData_Get_Struct(self, RecordBatchQueue, &record_batch_queue_type, data);
+    std::shared_ptr<arrow::RecordBatchReader> reader = data->queue;
+    return GOBJ2RVAL_UNREF(garrow_record_batch_reader_new_raw(&reader,
+                                                              nullptr));
+  }
+
+  VALUE
+  prepared_statement_execute_arrow(int argc, VALUE *argv, VALUE self)
+  {
+    VALUE rb_options;
+    rb_scan_args(argc, argv, ":", &rb_options);
+    QueryOptions options;
+    query_options_parse(rb_options, &options);
+
+    auto ctx = get_struct_prepared_statement(self);
+
+    auto connection = rb_iv_get(self, "@connection");
+    auto raw_connection = connection_get_raw(connection);
+    if (!raw_connection) {
+      rb_raise(eDuckDBError, "Database connection closed");
+    }
+    auto result = result_new(connection, options);
+    auto arrow_duckdb_result = result_get(result);
+    auto reader = arrow_duckdb_result->reader.get();
+    arrow::Status status;
+    call_without_gvl(raw_connection, [&]() {
+      if (options.stream) {
+        status = reader->execute_streaming(raw_connection,
+                                           ctx->prepared_statement);
+      } else {
+        status = reader->execute(raw_connection, ctx->prepared_statement);
+      }
+    });
+    check_status(status, "[arrow-duckdb][prepared-statement][execute]");
+    if (options.stream) {
+      // The streaming result refers the prepared statement.
+      arrow_duckdb_result->rb_prepared_statement = self;
+    }
+
+    return result;
+  }
+
+  enum class AsyncQueryPhase {
+    PENDING,
+    RUNNING,
+    DONE,
+  };
+
+  // Shared by an async query, its native thread and the next async
+  // query of the same connection. Guarded by async_query_mutex.
+  struct AsyncQueryProgress {
+    AsyncQueryPhase phase = AsyncQueryPhase::PENDING;
+    bool canceled = false;
+    arrow::Status status;
+  };
+
+  // async_query_changed is notified when an async query is canceled
+  // or its phase is changed.
+  std::mutex async_query_mutex;
+  std::condition_variable async_query_changed;
+
+  // Runs a query in a native thread. Completion is notified by
+  // writing to a pipe. So a Fiber scheduler can wait for it without
+  // blocking its event loop.
+  //
+  // Async queries of the same connection run one by one. So #cancel
+  // interrupts the connection only while its own query runs.
+  struct AsyncQuery {
+    std::thread thread;
+    duckdb_connection connection = nullptr;
+    std::shared_ptr<AsyncQueryProgress> progress;
+    bool finished = false;
+    VALUE io = Qnil;
+    VALUE result = Qnil;
+    // The connection or the prepared statement.
+    VALUE source = Qnil;
+  };
+
+  // Unfinished queries. The native thread uses their sources. So
+  // they must not be freed until they are done. Done queries are
+  // removed by async_query_sweep().
+  VALUE async_queries = Qnil;
+
+  bool
+  async_query_is_done(AsyncQuery *async_query)
+  {
+    std::lock_guard<std::mutex> lock(async_query_mutex);
+    return async_query->progress->phase == AsyncQueryPhase::DONE;
+  }
+
+  void
+  async_query_mark(void *data)
+  {
+    auto async_query = static_cast<AsyncQuery *>(data);
+    rb_gc_mark(async_query->io);
+    rb_gc_mark(async_query->result);
+    rb_gc_mark(async_query->source);
+  }
+
+  // A query isn't freed until it's done except at exit. We don't
+  // block exit by a running query. The native thread refers only
+  // the shared progress.
+  void
+  async_query_free(void *data)
+  {
+    auto async_query = static_cast<AsyncQuery *>(data);
+    if (async_query->thread.joinable()) {
+      if (async_query_is_done(async_query)) {
+        async_query->thread.join();
+      } else {
+        async_query->thread.detach();
+      }
+    }
+    delete async_query;
+  }
+
+  static const rb_data_type_t async_query_type = {
+    "ArrowDuckDB::AsyncQuery",
+    {
+      async_query_mark,
+      async_query_free,
+    },
+    nullptr,
+    nullptr,
+    0,
+  };
+
+  AsyncQuery *
+  async_query_get(VALUE self)
+  {
+    AsyncQuery *async_query;
+    TypedData_Get_Struct(self, AsyncQuery, &async_query_type, async_query);
+    return async_query;
+  }
+
+  int
+  async_query_sweep_foreach(VALUE rb_async_query, VALUE, VALUE)
+  {
+    if (async_query_is_done(async_query_get(rb_async_query))) {
+      return ST_DELETE;
+    }
+    return ST_CONTINUE;
+  }
+
+  // Removes done queries that aren't finished. Returns the pending
+  // queries of the connection.
+  VALUE
+  async_query_sweep(VALUE connection)
+  {
+    rb_hash_foreach(async_queries, async_query_sweep_foreach, Qnil);
+    auto pending_async_queries = rb_ary_new();
+    auto async_queries_of_connection =
+      rb_iv_get(connection, "@arrow_async_queries");
+    if (!NIL_P(async_queries_of_connection)) {
+      auto n = RARRAY_LEN(async_queries_of_connection);
+      for (long i = 0; i < n; ++i) {
+        auto rb_async_query = RARRAY_AREF(async_queries_of_connection, i);
+        if (!async_query_is_done(async_query_get(rb_async_query))) {
+          rb_ary_push(pending_async_queries, rb_async_query);
+        }
+      }
+    }
+    rb_iv_set(connection, "@arrow_async_queries", pending_async_queries);
+    return pending_async_queries;
+  }
+
+  // task is called in a native thread without the GVL after the
+  // previous async query of the connection is done.
+  VALUE
+  async_query_start(VALUE source,
+                    VALUE connection,
+                    duckdb_connection raw_connection,
+                    VALUE result,
+                    std::function<arrow::Status()> task)
+  {
+    auto pending_async_queries = async_query_sweep(connection);
+    auto async_query = new AsyncQuery();
+    auto rb_async_query = TypedData_Wrap_Struct(cArrowDuckDBAsyncQuery,
+                                                &async_query_type,
+                                                async_query);
+    async_query->connection = raw_connection;
+    async_query->progress = std::make_shared<AsyncQueryProgress>();
+    async_query->result = result;
+    async_query->source = source;
+    int notify_fds[2];
+    if (rb_pipe(notify_fds) == -1) {
+      rb_sys_fail("[arrow-duckdb][async-query] failed to create pipe");
+    }
+    async_query->io = rb_io_fdopen(notify_fds[0], O_RDONLY, nullptr);
+    bool started = false;
+    // C++ objects must be destroyed before raising.
+    {
+      std::shared_ptr<AsyncQueryProgress> previous;
+      if (RARRAY_LEN(pending_async_queries) > 0) {
+        auto last = rb_ary_entry(pending_async_queries, -1);
+        previous = async_query_get(last)->progress;
+      }
+      auto notify_fd = notify_fds[1];
+      auto progress = async_query->progress;
+      try {
+        async_query->thread =
+          std::thread([progress,
+                       previous,
+                       raw_connection,
+                       notify_fd,
+                       task = std::move(task)]() mutable {
+            bool canceled;
+            {
+              std::unique_lock<std::mutex> lock(async_query_mutex);
+              async_query_changed.wait(lock, [&]() {
+                return progress->canceled ||
+                  !previous ||
+                  previous->phase == AsyncQueryPhase::DONE;
+              });
+              canceled = progress->canceled;
+              if (!canceled) {
+                progress->phase = AsyncQueryPhase::RUNNING;
+              }
+            }
+            previous.reset();
+            arrow::Status status;
+            if (canceled) {
+              status = duckdb_error("Failed to execute query", "canceled");
+            } else {
+              // Nobody waits for this thread with the GVL.
+              arrow_duckdb::GVLReleasedScope gvl_released(raw_connection);
+              status = task();
+            }
+            task = nullptr;
+            char byte = 0;
+            while (write(notify_fd, &byte, 1) == -1 && errno == EINTR) {
+            }
+            close(notify_fd);
+            {
+              std::lock_guard<std::mutex> lock(async_query_mutex);
+              progress->status = std::move(status);
+              progress->phase = AsyncQueryPhase::DONE;
+            }
+            async_query_changed.notify_all();
+          });
+        started = true;
+      } catch (const std::system_error &) {
+      }
+      if (!started) {
+        close(notify_fd);
+      }
+    }
+    if (!started) {
+      rb_io_close(async_query->io);
+      rb_raise(eDuckDBError,
+               "[arrow-duckdb][async-query] failed to start thread");
+    }
+    rb_hash_aset(async_queries, rb_async_query, Qtrue);
+    rb_ary_push(pending_async_queries, rb_async_query);
+    return rb_async_query;
+  }
+
+  struct AsyncQueryWait {
+    AsyncQueryProgress *progress;
+    bool interrupted;
+  };
+
+  void *
+  async_query_wait_body(void *user_data)
+  {
+    auto wait = static_cast<AsyncQueryWait *>(user_data);
+    std::unique_lock<std::mutex> lock(async_query_mutex);
+    async_query_changed.wait(lock, [&]() {
+      return wait->interrupted ||
+        wait->progress->phase == AsyncQueryPhase::DONE;
+    });
+    return nullptr;
+  }
+
+  void
+  async_query_wait_interrupt(void *user_data)
+  {
+    auto wait = static_cast<AsyncQueryWait *>(user_data);
+    {
+      std::lock_guard<std::mutex> lock(async_query_mutex);
+      wait->interrupted = true;
+    }
+    async_query_changed.notify_all();
+  }
+
+  // Waits for the native thread without the GVL. Thread#raise and so
+  // on stop waiting but don't interrupt the query. Use #cancel for
+  // it.
+  void
+  async_query_join(AsyncQuery *async_query)
+  {
+    AsyncQueryWait wait = {async_query->progress.get(), false};
+    while (!async_query_is_done(async_query)) {
+      wait.interrupted = false;
+      rb_thread_call_without_gvl(async_query_wait_body,
+                                 &wait,
+                                 async_query_wait_interrupt,
+                                 &wait);
+      rb_thread_check_ints();
+    }
+    if (async_query->thread.joinable()) {
+      async_query->thread.join();
+    }
+  }
+
+  VALUE
+  async_query_io(VALUE self)
+  {
+    return async_query_get(self)->io;
+  }
+
+  VALUE
+  async_query_done_p(VALUE self)
+  {
+    return async_query_is_done(async_query_get(self)) ? Qtrue : Qfalse;
+  }
+
+  // Waits for the query without raising its error. The result is
+  // still available by #finish.
+  VALUE
+  async_query_wait(VALUE self)
+  {
+    async_query_join(async_query_get(self));
+    return self;
+  }
+
+  // Waits for the query and returns ArrowDuckDB::Result. Wait for
+  // #io to be readable before this not to block other fibers. #io is
+  // closed by this.
+  VALUE
+  async_query_finish(VALUE self)
+  {
+    auto async_query = async_query_get(self);
+    if (!async_query->finished) {
+      async_query_join(async_query);
+      async_query->finished = true;
+      rb_io_close(async_query->io);
+      rb_hash_delete(async_queries, self);
+    }
+    arrow::Status status;
+    {
+      std::lock_guard<std::mutex> lock(async_query_mutex);
+      status = async_query->progress->status;
+    }
+    check_status(status, "[arrow-duckdb][async-query]");
+    return async_query->result;
+  }
+
+  // A pending query is canceled without running. A running query is
+  // interrupted. Other queries of the connection aren't affected.
+  VALUE
+  async_query_cancel(VALUE self)
+  {
+    auto async_query = async_query_get(self);
+    {
+      std::lock_guard<std::mutex> lock(async_query_mutex);
+      auto progress = async_query->progress;
+      switch (progress->phase) {
+      case AsyncQueryPhase::PENDING:
+        progress->canceled = true;
+        break;
+      case AsyncQueryPhase::RUNNING:
+        duckdb_interrupt(async_query->connection);
+        break;
+      case AsyncQueryPhase::DONE:
+        break;
+      }
+    }
+    async_query_changed.notify_all();
+    return self;
+  }
+
+  // Waits for pending async queries of the connection. They use the
+  // connection in native threads.
+  VALUE
+  connection_wait_arrow_async_queries(VALUE self)
+  {
+    auto pending_async_queries = async_query_sweep(self);
+    auto n = RARRAY_LEN(pending_async_queries);
+    for (long i = 0; i < n; ++i) {
+      auto rb_async_query = RARRAY_AREF(pending_async_queries, i);
+      async_query_join(async_query_get(rb_async_query));
+    }
+    async_query_sweep(self);
+    return Qnil;
+  }
+
+  VALUE
+  query_sql_arrow_async(int argc, VALUE *argv, VALUE self)
+  {
+    VALUE sql;
+    VALUE rb_options;
+    rb_scan_args(argc, argv, "1:", &sql, &rb_options);
+    QueryOptions options;
+    query_options_parse(rb_options, &options);
+
+    auto ctx = get_struct_connection(self);
+
+    if (!(ctx->con)) {
+      rb_raise(eDuckDBError, "Database connection closed");
+    }
+
+    auto result = result_new(self, options);
+    auto reader = result_get(result)->reader;
+    auto connection = ctx->con;
+    StringValue(sql);
+    std::string c_sql(RSTRING_PTR(sql), RSTRING_LEN(sql));
+    auto stream = options.stream;
+    return async_query_start(
+      self,
+      self,
+      connection,
+      result,
+      [reader, connection, c_sql = std::move(c_sql), stream]() {
+        if (stream) {
+          return reader->query_streaming(connection, c_sql.c_str());
+        } else {
+          return reader->query(connection, c_sql.c_str());
+        }
+      });
+  }
+
+  VALUE
+  prepared_statement_execute_arrow_async(int argc, VALUE *argv, VALUE self)
+  {
+    VALUE rb_options;
+    rb_scan_args(argc, argv, ":", &rb_options);
+    QueryOptions options;
+    query_options_parse(rb_options, &options);
+
+    auto ctx = get_struct_prepared_statement(self);
+
+    auto connection = rb_iv_get(self, "@connection");
+    auto raw_connection = connection_get_raw(connection);
+    if (!raw_connection) {
+      rb_raise(eDuckDBError, "Database connection closed");
+    }
+    auto result = result_new(connection, options);
+    auto arrow_duckdb_result = result_get(result);
+    auto reader = arrow_duckdb_result->reader;
+    auto prepared_statement = ctx->prepared_statement;
+    auto stream = options.stream;
+    if (stream) {
+      // The streaming result refers the prepared statement.
+      arrow_duckdb_result->rb_prepared_statement = self;
+    }
+    return async_query_start(
+      self,
+      connection,
+      raw_connection,
+      result,
+      [reader, raw_connection, prepared_statement, stream]() {
+        if (stream) {
+          return reader->execute_streaming(raw_connection, prepared_statement);
+        } else {
+          return reader->execute(raw_connection, prepared_statement);
+        }
+      });
+  }
+
+  // This is also used for times.
+  int64_t
+  timestamp_to_micros(int64_t value, arrow::TimeUnit::type unit)
+  {
+    switch (unit) {
+    case arrow::TimeUnit::SECOND:
+      return value * 1000000;
+    case arrow::TimeUnit::MILLI:
+      return value * 1000;
+    case arrow::TimeUnit::MICRO:
+      return value;
+    case arrow::TimeUnit::NANO:
+    default:
+      {
+        // Floor not truncation for timestamps before the epoch.
+        auto micros = value / 1000;
+        if (value % 1000 < 0) {
+          --micros;
+        }
+        return micros;
+      }
+    }
+  }
+
+  // Binds the i-th value of array to the index-th parameter.
+  arrow::Status
+  prepared_statement_bind_arrow(duckdb_prepared_statement prepared_statement,
+                                idx_t index,
+                                const arrow::Array &array,
+                                int64_t i)
+  {
+    duckdb_state state;
+    if (array.IsNull(i)) {
+      state = duckdb_bind_null(prepared_statement, index);
+    } else {
+      switch (array.type_id()) {
+      case arrow::Type::BOOL:
+        state = duckdb_bind_boolean(
+          prepared_statement,
+          index,
+          static_cast<const arrow::BooleanArray &>(array).Value(i));
+        break;
+      case arrow::Type::INT8:
+        state = duckdb_bind_int8(
+          prepared_statement,
+          index,
+          static_cast<const arrow::Int8Array &>(array).Value(i));
+        break;
+      case arrow::Type::INT16:
+        state = duckdb_bind_int16(
+          prepared_statement,
+          index,
+          static_cast<const arrow::Int16Array &>(array).Value(i));
+        break;
+      case arrow::Type::INT32:
+        state = duckdb_bind_int32(
+          prepared_statement,
+          index,
+          static_cast<const arrow::Int32Array &>(array).Value(i));
+        break;
+      case arrow::Type::INT64:
+        state = duckdb_bind_int64(
+          prepared_statement,
+          index,
+          static_cast<const arrow::Int64Array &>(array).Value(i));
+        break;
+      case arrow::Type::UINT8:
+        state = duckdb_bind_uint8(
+          prepared_statement,
+          index,
+          static_cast<const arrow::UInt8Array &>(array).Value(i));
+        break;
+      case arrow::Type::UINT16:
+        state = duckdb_bind_uint16(
+          prepared_statement,
+          index,
+          static_cast<const arrow::UInt16Array &>(array).Value(i));
+        break;
+      case arrow::Type::UINT32:
+        state = duckdb_bind_uint32(
+          prepared_statement,
+          index,
+          static_cast<const arrow::UInt32Array &>(array).Value(i));
+        break;
+      case arrow::Type::UINT64:
+        state = duckdb_bind_uint64(
+          prepared_statement,
+          index,
+          static_cast<const arrow::UInt64Array &>(array).Value(i));
+        break;
+      case arrow::Type::FLOAT:
+        state = duckdb_bind_float(
+          prepared_statement,
+          index,
+          static_cast<const arrow::FloatArray &>(array).Value(i));
+        break;
+      case arrow::Type::DOUBLE:
+        state = duckdb_bind_double(
+          prepared_statement,
+          index,
+          static_cast<const arrow::DoubleArray &>(array).Value(i));
+        break;
+      case arrow::Type::STRING:
+        {
+          auto value = static_cast<const arrow::StringArray &>(array).GetView(i);
+          state = duckdb_bind_varchar_length(prepared_statement,
+                                             index,
+                                             value.data(),
+                                             value.size());
+        }
+        break;
+      case arrow::Type::LARGE_STRING:
+        {
+          auto value =
+            static_cast<const arrow::LargeStringArray &>(array).GetView(i);
+          state = duckdb_bind_varchar_length(prepared_statement,
+                                             index,
+                                             value.data(),
+                                             value.size());
+        }
+        break;
+      case arrow::Type::BINARY:
+        {
+          auto value = static_cast<const arrow::BinaryArray &>(array).GetView(i);
+          state = duckdb_bind_blob(prepared_statement,
+                                   index,
+                                   value.data(),
+                                   value.size());
+        }
+        break;
+      case arrow::Type::LARGE_BINARY:
+        {
+          auto value =
+            static_cast<const arrow::LargeBinaryArray &>(array).GetView(i);
+          state = duckdb_bind_blob(prepared_statement,
+                                   index,
+                                   value.data(),
+                                   value.size());
+        }
+        break;
+      case arrow::Type::DECIMAL128:
+        {
+          const auto &decimal_type =
+            static_cast<const arrow::Decimal128Type &>(*(array.type()));
+          arrow::Decimal128 value(
+            static_cast<const arrow::Decimal128Array &>(array).GetValue(i));
+          duckdb_decimal decimal;
+          decimal.width = static_cast<uint8_t>(decimal_type.precision());
+          decimal.scale = static_cast<uint8_t>(decimal_type.scale());
+          decimal.value.lower = value.low_bits();
+          decimal.value.upper = value.high_bits();
+          state = duckdb_bind_decimal(prepared_statement, index, decimal);
+        }
+        break;
+      case arrow::Type::DATE32:
+        {
+          duckdb_date date;
+          date.days = static_cast<const arrow::Date32Array &>(array).Value(i);
+          state = duckdb_bind_date(prepared_statement, index, date);
+        }
+        break;
+      case arrow::Type::DATE64:
+        {
+          const int64_t millis_per_day = 24 * 60 * 60 * 1000;
+          auto millis = static_cast<const arrow::Date64Array &>(array).Value(i);
+          // Floor not truncation for dates before the epoch.
+          auto days = millis / millis_per_day;
+          if (millis % millis_per_day < 0) {
+            --days;
+          }
+          duckdb_date date;
+          date.days = static_cast<int32_t>(days);
+          state = duckdb_bind_date(prepared_statement, index, date);
+        }
+        break;
+      case arrow::Type::TIME32:
+        {
+          const auto &time_type =
+            static_cast<const arrow::Time32Type &>(*(array.type()));
+          duckdb_time time;
+          time.micros = timestamp_to_micros(
+            static_cast<const arrow::Time32Array &>(array).Value(i),
+            time_type.unit());
+          state = duckdb_bind_time(prepared_statement, index, time);
+        }
+        break;
+      case arrow::Type::TIME64:
+        {
+          const auto &time_type =
+            static_cast<const arrow::Time64Type &>(*(array.type()));
+          duckdb_time time;
+          time.micros = timestamp_to_micros(
+            static_cast<const arrow::Time64Array &>(array).Value(i),
+            time_type.unit());
+          state = duckdb_bind_time(prepared_statement, index, time);
+        }
+        break;
+      case arrow::Type::TIMESTAMP:
+        {
+          const auto &timestamp_array =
+            static_cast<const arrow::TimestampArray &>(array);
+          const auto &timestamp_type =
+            static_cast<const arrow::TimestampType &>(*(array.type()));
+          duckdb_timestamp timestamp;
+          timestamp.micros = timestamp_to_micros(timestamp_array.Value(i),
+                                                 timestamp_type.unit());
+          // Both of Apache Arrow and DuckDB use UTC for timestamps
+          // with time zone.
+          if (timestamp_type.timezone().empty()) {
+            state = duckdb_bind_timestamp(prepared_statement, index, timestamp);
+          } else {
+            state = duckdb_bind_timestamp_tz(prepared_statement,
+                                             index,
+                                             timestamp);
+          }
+        }
+        break;
+      case arrow::Type::DICTIONARY:
+        {
+          // The value in the dictionary is bound.
+          const auto &dictionary_array =
+            static_cast<const arrow::DictionaryArray &>(array);
+          return prepared_statement_bind_arrow(
+            prepared_statement,
+            index,
+            *(dictionary_array.dictionary()),
+            dictionary_array.GetValueIndex(i));
+        }
+      default:
+        return arrow::Status::NotImplemented(
+          "[arrow-duckdb][prepared-statement][bind] unsupported type: ",
+          array.type()->ToString());
+      }
+    }
+    if (state == DuckDBError) {
+      return duckdb_error("Failed to bind parameter", nullptr);
+    }
+    return arrow::Status::OK();
+  }
+
+  // duckdb_interrupt() interrupts only the running query. A batch
+  // runs one query per row. So an interrupt between rows is lost
+  // without canceled.
+  struct ExecuteBatchInterrupt {
+    duckdb_connection connection;
+    std::atomic<bool> canceled;
+  };
+
+  void
+  execute_batch_interrupt(void *user_data)
+  {
+    auto interrupt = static_cast<ExecuteBatchInterrupt *>(user_data);
+    interrupt->canceled = true;
+    duckdb_interrupt(interrupt->connection);
+  }
+
+  // Executes prepared_statement for each row of params. The result
+  // has "row_index" column as the first column. It's the index of
+  // params row that produces the result row.
+  //
+  // DuckDB's C API binds only scalar parameters. So this executes
+  // prepared_statement once per row. Each result is streamed not to
+  // materialize it in DuckDB and record batches are concatenated
+  // without copying. canceled is checked before each row.
+  arrow::Result<std::shared_ptr<arrow::Table>>
+  prepared_statement_execute_batch(duckdb_connection connection,
+                                   duckdb_prepared_statement prepared_statement,
+                                   const arrow::RecordBatch &params,
+                                   const std::atomic<bool> &canceled)
+  {
+    auto n_params = duckdb_nparams(prepared_statement);
+    if (static_cast<idx_t>(params.num_columns()) != n_params) {
+      return arrow::Status::Invalid(
+        "[arrow-duckdb][prepared-statement][execute-batch] ",
+        "the number of columns must be the number of parameters: ",
+        "expected: <", n_params, ">: ",
+        "actual: <", params.num_columns(), ">");
+    }
+
+    auto row_index_field = arrow::field("row_index", arrow::int64(), false);
+    std::shared_ptr<arrow::Schema> schema;
+    if (params.num_rows() == 0) {
+      ARROW_ASSIGN_OR_RAISE(
+        auto result_schema,
+        arrow_duckdb::prepared_statement_schema(connection,
+                                                prepared_statement));
+      ARROW_ASSIGN_OR_RAISE(schema,
+                            result_schema->AddField(0, row_index_field));
+    }
+    arrow::RecordBatchVector record_batches;
+    for (int64_t i = 0; i < params.num_rows(); ++i) {
+      duckdb_clear_bindings(prepared_statement);
+      if (canceled) {
+        return arrow::Status::Cancelled(
+          "[arrow-duckdb][prepared-statement][execute-batch] canceled: ",
+          "row <", i, ">");
+      }
+      for (int j = 0; j < params.num_columns(); ++j) {
+        const auto &column = params.column(j);
+        auto status =
+          prepared_statement_bind_arrow(prepared_statement, j + 1, *column, i);
+        if (!status.ok()) {
+          return status.WithMessage(status.message(),
+                                    ": column <", j, ">: ",
+                                    "name <", params.column_name(j), ">: ",
+                                    "row <", i, ">: ",
+                                    "type <", column->type()->ToString(), ">");
+        }
+      }
+      ResultReader reader(0);
+      ARROW_RETURN_NOT_OK(reader.execute_streaming(connection,
+                                                   prepared_statement));
+      if (!schema) {
+        ARROW_ASSIGN_OR_RAISE(schema,
+                              reader.schema()->AddField(0, row_index_field));
+      }
+      while (true) {
+        std::shared_ptr<arrow::RecordBatch> record_batch;
+        ARROW_RETURN_NOT_OK(reader.ReadNext(&record_batch));
+        if (!record_batch) {
+          break;
+        }
+        ARROW_ASSIGN_OR_RAISE(
+          auto row_index,
+          arrow::MakeArrayFromScalar(arrow::Int64Scalar(i),
+                                     record_batch->num_rows()));
+        ARROW_ASSIGN_OR_RAISE(
+          record_batch,
+          record_batch->AddColumn(0, row_index_field, row_index));
+        record_batches.push_back(std::move(record_batch));
+      }
+    }
+    duckdb_clear_bindings(prepared_statement);
+    return arrow::Table::FromRecordBatches(schema, record_batches);
+  }
+
+  VALUE
+  prepared_statement_execute_arrow_batch(VALUE self, VALUE rb_params)
+  {
+    if (!RVAL2CBOOL(rb_obj_is_kind_of(rb_params, cArrowRecordBatch))) {
+      rb_raise(rb_eArgError,
+               "must be Arrow::RecordBatch: %" PRIsVALUE,
+               rb_params);
+    }
+
+    auto ctx = get_struct_prepared_statement(self);
+    auto connection = rb_iv_get(self, "@connection");
+    auto raw_connection = connection_get_raw(connection);
+    if (!raw_connection) {
+      rb_raise(eDuckDBError, "Database connection closed");
+    }
+    auto gparams = GARROW_RECORD_BATCH(RVAL2GOBJ(rb_params));
+    std::shared_ptr<arrow::Table> table;
+    arrow::Status status;
+    ExecuteBatchInterrupt interrupt{raw_connection, {false}};
+    // This is call_without_gvl() with canceled.
+    auto body = [&]() {
+      arrow_duckdb::GVLReleasedScope gvl_released(raw_connection);
+      auto params = garrow_record_batch_get_raw(gparams);
+      auto table_result =
+        prepared_statement_execute_batch(raw_connection,
+                                         ctx->prepared_statement,
+                                         *params,
+                                         interrupt.canceled);
+      if (table_result.ok()) {
+        table = *table_result;
+      } else {
+        status = table_result.status();
+      }
+    };
+    rb_thread_call_without_gvl(without_gvl_body<decltype(body)>,
+                               &body,
+                               execute_batch_interrupt,
+                               &interrupt);
+    RB_GC_GUARD(rb_params);
+    check_status(status, "[arrow-duckdb][prepared-statement][execute-batch]");
+    return GOBJ2RVAL_UNREF(garrow_table_new_raw(&table));
+  }
+
+  // Runs Ruby code for scalar functions. DuckDB calls scalar
+  // functions in its worker threads too. They aren't Ruby threads and
+  // can't use Ruby API. They pass Ruby code to the Ruby thread that
+  // runs serve() and wait for it.
+  class FunctionExecutor {
+  public:
+    // Called with the GVL.
+    using Task = std::function<arrow::Status()>;
+
+    // This can be called by any thread. gvl_released is whether the
+    // Ruby thread that runs the query doesn't have the GVL. If it has
+    // the GVL, other threads can't get the GVL until the query
+    // finishes.
+    arrow::Status
+    run(Task task, bool gvl_released)
+    {
+      if (ruby_native_thread_p()) {
+        if (ruby_thread_has_gvl_p()) {
+          return task();
+        }
+        // The Ruby thread that runs the query without the GVL.
+        arrow::Status status;
+        auto body = [&]() { status = task(); };
+        rb_thread_call_with_gvl(without_gvl_body<decltype(body)>, &body);
+        return status;
+      }
+
+      if (!gvl_released) {
+        return arrow::Status::Invalid(
+          "[arrow-duckdb][function] DuckDB's worker threads can't call Ruby ",
+          "while the query holds the GVL: use query(..., output: :arrow)");
+      }
+
+      Request request{std::move(task)};
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (stopped_) {
+        return stopped_status();
+      }
+      // Nobody serves the request. We must not wait forever.
+      if (!serving_) {
+        return arrow::Status::Invalid(
+          "[arrow-duckdb][function] no Ruby thread serves functions");
+      }
+      requests_.push_back(&request);
+      condition_.notify_all();
+      condition_.wait(lock, [&] { return request.done; });
+      return request.status;
+    }
+
+    // Called by a dedicated Ruby thread with the GVL.
+    void
+    serve()
+    {
+      while (true) {
+        Request *request = nullptr;
+        auto wait = [&]() {
+          std::unique_lock<std::mutex> lock(mutex_);
+          condition_.wait(lock, [&] { return stopped_ || !requests_.empty(); });
+          if (!stopped_) {
+            request = requests_.front();
+            requests_.pop_front();
+          }
+        };
+        rb_thread_call_without_gvl(without_gvl_body<decltype(wait)>,
+                                   &wait,
+                                   interrupt,
+                                   this);
+        if (!request) {
+          break;
+        }
+        auto status = request->task();
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          request->status = std::move(status);
+          request->done = true;
+        }
+        condition_.notify_all();
+      }
+    }
+
+    bool
+    is_serving()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return serving_;
+    }
+
+    void
+    start_serving()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      serving_ = true;
+      stopped_ = false;
+    }
+
+  private:
+    struct Request {
+      Task task;
+      arrow::Status status;
+      bool done = false;
+    };
 
-extern "C" void Init_arrow_duckdb(void);
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<Request *> requests_;
+    bool serving_ = false;
+    bool stopped_ = false;
 
-namespace {
-#  if !GARROW_VERSION_CHECK(6, 0, 0)
-  GArrowSchema *
-  garrow_schema_import(gpointer c_abi_schema,
-                       GError **error)
+    static arrow::Status
+    stopped_status()
+    {
+      return arrow::Status::Cancelled(
+        "[arrow-duckdb][function] the Ruby thread for functions was stopped");
+    }
+
+    // Thread#kill and so on stop serving. Waiting DuckDB threads get
+    // an error.
+    static void
+    interrupt(void *user_data)
+    {
+      auto executor = static_cast<FunctionExecutor *>(user_data);
+      std::lock_guard<std::mutex> lock(executor->mutex_);
+      executor->serving_ = false;
+      executor->stopped_ = true;
+      for (auto request : executor->requests_) {
+        request->status = stopped_status();
+        request->done = true;
+      }
+      executor->requests_.clear();
+      executor->condition_.notify_all();
+    }
+  };
+
+  FunctionExecutor function_executor;
+
+  VALUE
+  function_executor_serve(void *)
   {
-    auto arrow_schema =
-      *arrow::ImportSchema(static_cast<ArrowSchema *>(c_abi_schema));
-    return garrow_schema_new_raw(&arrow_schema);
+    function_executor.serve();
+    return Qnil;
   }
 
-  GArrowRecordBatch *
-  garrow_record_batch_import(gpointer c_abi_array,
-                             GArrowSchema *schema,
-                             GError **error)
+  void
+  function_executor_ensure_serving()
   {
-    auto arrow_schema = garrow_schema_get_raw(schema);
-    auto arrow_record_batch =
-      *arrow::ImportRecordBatch(static_cast<ArrowArray *>(c_abi_array),
-                                arrow_schema);
-    return garrow_record_batch_new_raw(&arrow_record_batch);
+    if (function_executor.is_serving()) {
+      return;
+    }
+    function_executor.start_serving();
+    rb_thread_create(function_executor_serve, nullptr);
   }
-#  endif
 
-  VALUE cArrowTable;
-  VALUE cArrowDuckDBResult;
+  // Blocks of registered functions. A block is marked while DuckDB
+  // refers its function. DuckDB drops a function when it's replaced
+  // or its database is closed. It may be dropped by a DuckDB thread
+  // without the GVL. So this uses a mutex instead of Ruby API.
+  class FunctionBlocks {
+  public:
+    // block is marked while the returned reference is alive.
+    std::shared_ptr<VALUE>
+    add(VALUE block)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        blocks_.insert(block);
+      }
+      return std::shared_ptr<VALUE>(new VALUE(block), [this](VALUE *block) {
+        remove(*block);
+        delete block;
+      });
+    }
 
-  struct Result {
-    duckdb_arrow arrow;
-    char *error_message;
-    GArrowSchema *gschema;
+    // Called by GC.
+    void
+    mark()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto block : blocks_) {
+        // C++ refers it. So it must not be moved.
+        rb_gc_mark(block);
+      }
+    }
+
+  private:
+    std::mutex mutex_;
+    std::unordered_multiset<VALUE> blocks_;
+
+    void
+    remove(VALUE block)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = blocks_.find(block);
+      if (it != blocks_.end()) {
+        blocks_.erase(it);
+      }
+    }
   };
 
+  FunctionBlocks function_blocks;
+
   void
-  result_free(void *data)
+  function_blocks_mark(void *data)
   {
-    Result *result = static_cast<Result *>(data);
-    if (result->gschema) {
-      g_object_unref(result->gschema);
-    }
-    free(result->error_message);
-    duckdb_destroy_arrow(&(result->arrow));
+    static_cast<FunctionBlocks *>(data)->mark();
   }
 
-  static const rb_data_type_t result_type = {
-    "ArrowDuckDB::Result",
+  static const rb_data_type_t function_blocks_type = {
+    "ArrowDuckDB::FunctionBlocks",
     {
+      function_blocks_mark,
       nullptr,
-      result_free,
     },
     nullptr,
     nullptr,
-    RUBY_TYPED_FREE_IMMEDIATELY,
+    0,
   };
 
-  VALUE
-  result_alloc_func(VALUE klass)
-  {
-    Result *result;
-    auto rb_result = TypedData_Make_Struct(klass,
-                                           Result,
-                                           &result_type,
-                                           result);
-    result->arrow = nullptr;
-    result->error_message = nullptr;
-    result->gschema = nullptr;
-    return rb_result;
-  }
+  // Marks function_blocks.
+  VALUE rb_function_blocks = Qnil;
 
-  void
-  result_ensure_gschema(Result *result)
+  struct FunctionCallData {
+    VALUE block;
+    const arrow::ArrayVector *args;
+    std::shared_ptr<arrow::Array> output;
+  };
+
+  VALUE
+  function_call_block_body(VALUE user_data)
   {
-    ArrowSchema c_abi_schema;
-    auto schema = reinterpret_cast<duckdb_arrow_schema>(&c_abi_schema);
-    auto state = duckdb_query_arrow_schema(result->arrow, &schema);
-    if (state == DuckDBError) {
-      free(result->error_message);
-      result->error_message =
-        const_cast<char *>(duckdb_query_arrow_error(result->arrow));
-      rb_raise(eDuckDBError,
-               "Failed to fetch Apache Arrow schema: %s",
-               result->error_message);
+    auto data = reinterpret_cast<FunctionCallData *>(user_data);
+    auto rb_args = rb_ary_new_capa(data->args->size());
+    for (auto array : *(data->args)) {
+      rb_ary_push(rb_args, GOBJ2RVAL_UNREF(garrow_array_new_raw(&array)));
     }
-
-    GError *gerror = nullptr;
-    result->gschema = garrow_schema_import(&c_abi_schema, &gerror);
-    if (gerror) {
-      RG_RAISE_ERROR(gerror);
+    auto rb_output = rb_proc_call(data->block, rb_args);
+    if (!RVAL2CBOOL(rb_obj_is_kind_of(rb_output, cArrowArray))) {
+      rb_raise(rb_eTypeError,
+               "must return Arrow::Array: %" PRIsVALUE,
+               rb_output);
     }
+    data->output = garrow_array_get_raw(GARROW_ARRAY(RVAL2GOBJ(rb_output)));
+    return Qnil;
   }
 
   VALUE
-  result_fetch_internal(VALUE self, Result *result)
+  error_message_body(VALUE error)
   {
-    ArrowArray c_abi_array = {};
-    auto array = reinterpret_cast<duckdb_arrow_array>(&c_abi_array);
-    auto state = duckdb_query_arrow_array(result->arrow, &array);
-    if (state == DuckDBError) {
-      free(result->error_message);
-      result->error_message =
-        const_cast<char *>(duckdb_query_arrow_error(result->arrow));
-      rb_raise(eDuckDBError,
-               "Failed to fetch Apache Arrow array: %s",
-               result->error_message);
-    }
-    if (!c_abi_array.release) {
-      return Qnil;
+    return rb_sprintf("%" PRIsVALUE ": %" PRIsVALUE,
+                      rb_obj_class(error),
+                      rb_funcall(error, rb_intern("message"), 0));
+  }
+
+  // Calls body with the GVL. Ruby exceptions must not be propagated
+  // to DuckDB's frames. They're converted to arrow::Status.
+  arrow::Status
+  call_protect(VALUE (*body)(VALUE), void *data, const char *context)
+  {
+    int state = 0;
+    rb_protect(body, reinterpret_cast<VALUE>(data), &state);
+    if (state == 0) {
+      return arrow::Status::OK();
     }
 
-    GError *gerror = nullptr;
-    auto grecord_batch = garrow_record_batch_import(&c_abi_array,
-                                                    result->gschema,
-                                                    &gerror);
-    if (gerror) {
-      RG_RAISE_ERROR(gerror);
-      return Qnil;
+    auto error = rb_errinfo();
+    rb_set_errinfo(Qnil);
+    if (NIL_P(error)) {
+      return arrow::Status::ExecutionError(context, " unexpected jump");
     }
-    return GOBJ2RVAL_UNREF(grecord_batch);
+    auto message = rb_protect(error_message_body, error, &state);
+    if (state != 0) {
+      rb_set_errinfo(Qnil);
+      return arrow::Status::ExecutionError(context, " failed to call");
+    }
+    return arrow::Status::ExecutionError(
+      context,
+      " ",
+      std::string(RSTRING_PTR(message), RSTRING_LEN(message)));
   }
 
-  VALUE
-  result_fetch(VALUE self)
+  arrow::Result<std::shared_ptr<arrow::Array>>
+  function_call_block(VALUE block, const arrow::ArrayVector &args)
   {
-    Result *result;
-    TypedData_Get_Struct(self, Result, &result_type, result);
+    FunctionCallData data{block, &args, nullptr};
+    ARROW_RETURN_NOT_OK(call_protect(function_call_block_body,
+                                     &data,
+                                     "[arrow-duckdb][function]"));
+    return std::move(data.output);
+  }
 
-    result_ensure_gschema(result);
+  arrow_duckdb::ScalarFunction
+  function_new_block(VALUE block)
+  {
+    auto block_ref = function_blocks.add(block);
+    return [block_ref](const arrow::ArrayVector &args,
+                       int64_t n_rows,
+                       bool gvl_released)
+      -> arrow::Result<std::shared_ptr<arrow::Array>> {
+      std::shared_ptr<arrow::Array> output;
+      // The GVL is acquired once per chunk.
+      ARROW_RETURN_NOT_OK(function_executor.run([&]() {
+        ARROW_ASSIGN_OR_RAISE(output, function_call_block(*block_ref, args));
+        return arrow::Status::OK();
+      }, gvl_released));
+      return output;
+    };
+  }
 
-    return result_fetch_internal(self, result);
+  arrow_duckdb::ScalarFunction
+  function_new_compute(const std::string &compute_function_name)
+  {
+    return [compute_function_name](const arrow::ArrayVector &args,
+                                   int64_t n_rows,
+                                   bool gvl_released)
+      -> arrow::Result<std::shared_ptr<arrow::Array>> {
+      std::vector<arrow::Datum> datums(args.begin(), args.end());
+      ARROW_ASSIGN_OR_RAISE(auto output,
+                            arrow::compute::CallFunction(compute_function_name,
+                                                         datums));
+      if (output.is_scalar()) {
+        return arrow::MakeArrayFromScalar(*(output.scalar()), n_rows);
+      }
+      return output.make_array();
+    };
   }
 
   VALUE
-  result_each(VALUE self)
+  query_register_arrow_function(int argc, VALUE *argv, VALUE self)
   {
-    RETURN_ENUMERATOR(self, 0, 0);
+    VALUE name;
+    VALUE rb_arg_types;
+    VALUE return_type;
+    VALUE rb_options;
+    VALUE block;
+    rb_scan_args(argc, argv, "3:&",
+                 &name, &rb_arg_types, &return_type, &rb_options, &block);
+    VALUE compute = Qnil;
+    if (!NIL_P(rb_options)) {
+      ID keywords[1];
+      CONST_ID(keywords[0], "compute");
+      VALUE values[1];
+      rb_get_kwargs(rb_options, keywords, 0, 1, values);
+      if (values[0] != Qundef) {
+        compute = values[0];
+      }
+    }
+    if (NIL_P(compute) == NIL_P(block)) {
+      rb_raise(rb_eArgError, "must specify either compute: or block");
+    }
 
-    Result *result;
-    TypedData_Get_Struct(self, Result, &result_type, result);
+    auto ctx = get_struct_connection(self);
+
+    if (!(ctx->con)) {
+      rb_raise(eDuckDBError, "Database connection closed");
+    }
 
-    result_ensure_gschema(result);
+    rb_arg_types = rb_ary_dup(rb_Array(rb_arg_types));
+    auto n_args = RARRAY_LEN(rb_arg_types);
+    for (long i = 0; i < n_args; ++i) {
+      rb_ary_store(rb_arg_types, i, rb_String(RARRAY_AREF(rb_arg_types, i)));
+    }
+    name = rb_String(name);
+    return_type = rb_String(return_type);
+    if (!NIL_P(compute)) {
+      compute = rb_String(compute);
+      auto registry = arrow::compute::GetFunctionRegistry();
+      auto function_result =
+        registry->GetFunction(std::string(RSTRING_PTR(compute),
+                                          RSTRING_LEN(compute)));
+      if (!function_result.ok()) {
+        rb_raise(rb_eArgError,
+                 "unknown Apache Arrow compute function: %" PRIsVALUE,
+                 compute);
+      }
+    } else {
+      function_executor_ensure_serving();
+    }
 
-    while (true) {
-      auto record_batch = result_fetch_internal(self, result);
-      if (NIL_P(record_batch)) {
-        break;
+    arrow::Status status;
+    {
+      std::vector<std::string> arg_types;
+      for (long i = 0; i < n_args; ++i) {
+        auto arg_type = RARRAY_AREF(rb_arg_types, i);
+        arg_types.emplace_back(RSTRING_PTR(arg_type), RSTRING_LEN(arg_type));
+      }
+      arrow_duckdb::ScalarFunction function;
+      if (NIL_P(compute)) {
+        function = function_new_block(block);
+      } else {
+        function = function_new_compute(std::string(RSTRING_PTR(compute),
+                                                    RSTRING_LEN(compute)));
+      }
+      try {
+        arrow_duckdb::connection_register_scalar_function(
+          ctx->con,
+          std::string(RSTRING_PTR(name), RSTRING_LEN(name)),
+          arg_types,
+          std::string(RSTRING_PTR(return_type), RSTRING_LEN(return_type)),
+          std::move(function));
+      } catch (const std::exception &error) {
+        status = duckdb_error("Failed to register function", error.what());
       }
-      rb_yield(record_batch);
     }
+    check_status(status, "[arrow-duckdb][register-function]");
 
     return self;
   }
 
-  VALUE
-  result_schema(VALUE self)
-  {
-    Result *result;
-    TypedData_Get_Struct(self, Result, &result_type, result);
-
-    result_ensure_gschema(result);
+  // Resolves unknown table names in queries to Apache Arrow data.
+  struct SourceResolver {
+    VALUE sources = Qnil;
+    VALUE resolver = Qnil;
+  };
 
-    return GOBJ2RVAL(result->gschema);
+  void
+  source_resolver_mark(void *data)
+  {
+    auto source_resolver = static_cast<SourceResolver *>(data);
+    // C++ refers them. So they must not be moved.
+    rb_gc_mark(source_resolver->sources);
+    rb_gc_mark(source_resolver->resolver);
   }
 
-  VALUE
-  result_n_columns(VALUE self)
+  void
+  source_resolver_free(void *data)
   {
-    Result *result;
-    TypedData_Get_Struct(self, Result, &result_type, result);
-
-    return ULL2NUM(duckdb_arrow_column_count(result->arrow));
+    delete static_cast<SourceResolver *>(data);
   }
 
-  VALUE
-  result_n_rows(VALUE self)
-  {
-    Result *result;
-    TypedData_Get_Struct(self, Result, &result_type, result);
+  static const rb_data_type_t source_resolver_type = {
+    "ArrowDuckDB::SourceResolver",
+    {
+      source_resolver_mark,
+      source_resolver_free,
+    },
+    nullptr,
+    nullptr,
+    RUBY_TYPED_FREE_IMMEDIATELY,
+  };
 
-    return ULL2NUM(duckdb_arrow_row_count(result->arrow));
-  }
+  struct SourceResolveData {
+    SourceResolver *source_resolver;
+    const std::string *name;
+    GObject *source;
+  };
 
   VALUE
-  result_n_changed_rows(VALUE self)
+  source_resolver_resolve_body(VALUE user_data)
   {
-    Result *result;
-    TypedData_Get_Struct(self, Result, &result_type, result);
-
-    return ULL2NUM(duckdb_arrow_rows_changed(result->arrow));
+    auto data = reinterpret_cast<SourceResolveData *>(user_data);
+    auto source_resolver = data->source_resolver;
+    auto name = rb_utf8_str_new(data->name->data(), data->name->size());
+    auto source = rb_hash_lookup2(source_resolver->sources, name, Qundef);
+    if (source == Qundef) {
+      source = rb_hash_lookup(source_resolver->sources, rb_str_intern(name));
+    }
+    if (NIL_P(source) && !NIL_P(source_resolver->resolver)) {
+      source = rb_funcall(source_resolver->resolver, rb_intern("call"), 1, name);
+    }
+    if (NIL_P(source)) {
+      return Qnil;
+    }
+    check_arrow_source(source);
+    data->source = G_OBJECT(g_object_ref(RVAL2GOBJ(source)));
+    return Qnil;
   }
 
-  VALUE
-  query_sql_arrow(VALUE self, VALUE sql)
+  // Returns the source resolver of the connection. This enables
+  // replacement scans on the first call.
+  SourceResolver *
+  connection_ensure_source_resolver(VALUE self)
   {
     auto ctx = get_struct_connection(self);
 
@@ -227,144 +3263,219 @@ namespace {
       rb_raise(eDuckDBError, "Database connection closed");
     }
 
-    ID id_new;
-    CONST_ID(id_new, "new");
-    auto result = rb_funcall(cArrowDuckDBResult, id_new, 0);
-    Result *arrow_duckdb_result;
-    TypedData_Get_Struct(result, Result, &result_type, arrow_duckdb_result);
-    auto state = duckdb_query_arrow(ctx->con,
-                                    StringValueCStr(sql),
-                                    &(arrow_duckdb_result->arrow));
-    if (state == DuckDBError) {
-      if (arrow_duckdb_result->arrow) {
-        arrow_duckdb_result->error_message =
-          const_cast<char *>(
-            duckdb_query_arrow_error(arrow_duckdb_result->arrow));
-        rb_raise(eDuckDBError,
-                 "Failed to execute query: %s",
-                 arrow_duckdb_result->error_message);
-      } else {
-        rb_raise(eDuckDBError, "Failed to execute query");
-      }
+    auto rb_source_resolver = rb_iv_get(self, "@arrow_source_resolver");
+    SourceResolver *source_resolver;
+    if (!NIL_P(rb_source_resolver)) {
+      TypedData_Get_Struct(rb_source_resolver,
+                           SourceResolver,
+                           &source_resolver_type,
+                           source_resolver);
+      return source_resolver;
     }
 
-    return result;
+    source_resolver = new SourceResolver();
+    rb_source_resolver = TypedData_Wrap_Struct(rb_cObject,
+                                               &source_resolver_type,
+                                               source_resolver);
+    source_resolver->sources = rb_hash_new();
+    rb_iv_set(self, "@arrow_source_resolver", rb_source_resolver);
+    // query_async binds queries in a native thread. It needs the Ruby
+    // thread that serves resolutions.
+    function_executor_ensure_serving();
+    arrow::Status status;
+    try {
+      arrow_duckdb::connection_set_source_resolver(
+        ctx->con,
+        [source_resolver](const std::string &name) -> arrow::Result<GObject *> {
+          SourceResolveData data{source_resolver, &name, nullptr};
+          // Queries are bound by the thread that runs them. It's a
+          // Ruby thread that may not have the GVL or a native thread
+          // of query_async that nobody waits for with the GVL.
+          ARROW_RETURN_NOT_OK(function_executor.run([&]() {
+            return call_protect(source_resolver_resolve_body,
+                                &data,
+                                "[arrow-duckdb][resolve-source]");
+          }, true));
+          return data.source;
+        });
+    } catch (const std::exception &error) {
+      status = duckdb_error("Failed to enable replacement scans",
+                            error.what());
+    }
+    check_status(status, "[arrow-duckdb][resolve-source]");
+    return source_resolver;
   }
 
   VALUE
-  query_unregister_arrow(VALUE self, VALUE name)
+  query_arrow_sources(VALUE self)
   {
-    auto ctx = get_struct_connection(self);
-
-    if (!(ctx->con)) {
-      rb_raise(eDuckDBError, "Database connection closed");
-    }
+    return connection_ensure_source_resolver(self)->sources;
+  }
 
-    arrow_duckdb::connection_unregister(ctx->con, name);
+  VALUE
+  query_resolve_arrow_source(VALUE self)
+  {
+    auto source_resolver = connection_ensure_source_resolver(self);
+    source_resolver->resolver = rb_block_given_p() ? rb_block_proc() : Qnil;
+    return self;
+  }
 
-    auto arrow_tables = rb_iv_get(self, "@arrow_tables");
-    if (NIL_P(arrow_tables)) {
-      arrow_tables = rb_hash_new();
-      rb_iv_set(self, "@arrow_tables", arrow_tables);
-    }
-    rb_hash_delete(arrow_tables, name);
+  struct SharedRegistrations {
+    std::shared_ptr<arrow_duckdb::SharedRegistrations> registrations;
+  };
 
-    return self;
+  void
+  shared_registrations_free(void *data)
+  {
+    delete static_cast<SharedRegistrations *>(data);
   }
 
+  static const rb_data_type_t shared_registrations_type = {
+    "ArrowDuckDB::SharedRegistrations",
+    {
+      nullptr,
+      shared_registrations_free,
+    },
+    nullptr,
+    nullptr,
+    RUBY_TYPED_FREE_IMMEDIATELY,
+  };
+
   VALUE
-  query_register_arrow_body(VALUE)
+  shared_registrations_alloc_func(VALUE klass)
   {
-    return rb_yield_values(0);
+    auto data = new SharedRegistrations();
+    data->registrations = std::make_shared<arrow_duckdb::SharedRegistrations>();
+    return TypedData_Wrap_Struct(klass, &shared_registrations_type, data);
   }
 
-  struct QueryRegisterArrowData {
-    VALUE self;
-    VALUE name;
-  };
+  arrow_duckdb::SharedRegistrations *
+  shared_registrations_get(VALUE self)
+  {
+    SharedRegistrations *data;
+    TypedData_Get_Struct(self,
+                         SharedRegistrations,
+                         &shared_registrations_type,
+                         data);
+    return data->registrations.get();
+  }
 
+  // The registration refers the GObject of source. So source can be
+  // freed by Ruby's GC while it's registered.
   VALUE
-  query_register_arrow_ensure(VALUE user_data)
+  shared_registrations_register(VALUE self,
+                                VALUE name,
+                                VALUE arrow_source,
+                                VALUE rb_statistics)
   {
-    auto data = reinterpret_cast<QueryRegisterArrowData *>(user_data);
-    return query_unregister_arrow(data->self, data->name);
+    auto registrations = shared_registrations_get(self);
+    check_arrow_source(arrow_source);
+    name = rb_String(name);
+    std::string c_name(RSTRING_PTR(name), RSTRING_LEN(name));
+    auto source = G_OBJECT(RVAL2GOBJ(arrow_source));
+    auto statistics = RVAL2CBOOL(rb_statistics);
+    arrow::Status status;
+    // Computing statistics may scan the whole data.
+    call_without_gvl(nullptr, [&]() {
+      try {
+        registrations->add(
+          c_name,
+          std::make_shared<arrow_duckdb::Registration>(source, statistics));
+      } catch (const std::exception &error) {
+        status = duckdb_error("Failed to register Apache Arrow data",
+                              error.what());
+      }
+    });
+    RB_GC_GUARD(arrow_source);
+    check_status(status, "[arrow-duckdb][shared-registrations][register]");
+    return self;
   }
 
   VALUE
-  query_register_arrow(VALUE self, VALUE name, VALUE arrow_table)
+  shared_registrations_unregister(VALUE self, VALUE name)
   {
-    auto ctx = get_struct_connection(self);
+    auto registrations = shared_registrations_get(self);
+    name = rb_String(name);
+    auto removed =
+      registrations->remove(std::string(RSTRING_PTR(name), RSTRING_LEN(name)));
+    return removed ? Qtrue : Qfalse;
+  }
+
+  VALUE
+  shared_registrations_attach(VALUE self, VALUE connection)
+  {
+    SharedRegistrations *data;
+    TypedData_Get_Struct(self,
+                         SharedRegistrations,
+                         &shared_registrations_type,
+                         data);
+    auto ctx = get_struct_connection(connection);
 
     if (!(ctx->con)) {
       rb_raise(eDuckDBError, "Database connection closed");
     }
 
-    if (!RVAL2CBOOL(rb_obj_is_kind_of(arrow_table, cArrowTable))) {
-      rb_raise(rb_eArgError, "must be Arrow::Table: %" PRIsVALUE, arrow_table);
-    }
-
-    arrow_duckdb::connection_register(ctx->con, name, arrow_table);
-
-    auto arrow_tables = rb_iv_get(self, "@arrow_tables");
-    if (NIL_P(arrow_tables)) {
-      arrow_tables = rb_hash_new();
-      rb_iv_set(self, "@arrow_tables", arrow_tables);
-    }
-    rb_hash_aset(arrow_tables, name, arrow_table);
-
-    if (rb_block_given_p()) {
-      QueryRegisterArrowData data;
-      data.self = self;
-      data.name = name;
-      return rb_ensure(query_register_arrow_body,
-                       Qnil,
-                       query_register_arrow_ensure,
-                       reinterpret_cast<VALUE>(&data));
-    } else {
-      return self;
+    arrow::Status status;
+    try {
+      arrow_duckdb::connection_set_shared_registrations(ctx->con,
+                                                        data->registrations);
+    } catch (const std::exception &error) {
+      status = duckdb_error("Failed to attach shared registrations",
+                            error.what());
     }
+    check_status(status, "[arrow-duckdb][shared-registrations][attach]");
+    return self;
   }
 
   VALUE
-  prepared_statement_execute_arrow(VALUE self)
+  arrow_duckdb_open_ipc_file(VALUE self, VALUE path)
   {
-    auto ctx = get_struct_prepared_statement(self);
-
-    ID id_new;
-    CONST_ID(id_new, "new");
-    auto result = rb_funcall(cArrowDuckDBResult, id_new, 0);
-    Result *arrow_duckdb_result;
-    TypedData_Get_Struct(result, Result, &result_type, arrow_duckdb_result);
-
-    auto state = duckdb_execute_prepared_arrow(ctx->prepared_statement,
-                                               &(arrow_duckdb_result->arrow));
-    if (state == DuckDBError) {
-      if (arrow_duckdb_result->arrow) {
-        arrow_duckdb_result->error_message =
-          const_cast<char *>(
-            duckdb_query_arrow_error(arrow_duckdb_result->arrow));
-        rb_raise(eDuckDBError,
-                 "Failed to execute prepared statement: %s",
-                 arrow_duckdb_result->error_message);
+    path = rb_str_new_frozen(rb_file_absolute_path(rb_get_path(path), Qnil));
+    std::string c_path(RSTRING_PTR(path), RSTRING_LEN(path));
+    std::shared_ptr<arrow::dataset::Dataset> dataset;
+    arrow::Status status;
+    call_without_gvl(nullptr, [&]() {
+      auto dataset_result = arrow_duckdb::open_ipc_file_dataset(c_path);
+      if (dataset_result.ok()) {
+        dataset = *dataset_result;
       } else {
-        rb_raise(eDuckDBError, "Failed to execute prepared statement");
+        status = dataset_result.status();
       }
-    }
-
-    return result;
+    });
+    check_status(status, "[arrow-duckdb][open-ipc-file]");
+    return GOBJ2RVAL_UNREF(gadataset_dataset_new_raw(&dataset));
   }
 
   void init()
   {
+    cArrowArray = rb_const_get(rb_const_get(rb_cObject, rb_intern("Arrow")),
+                               rb_intern("Array"));
     cArrowTable = rb_const_get(rb_const_get(rb_cObject, rb_intern("Arrow")),
                                rb_intern("Table"));
+    cArrowRecordBatch =
+      rb_const_get(rb_const_get(rb_cObject, rb_intern("Arrow")),
+                   rb_intern("RecordBatch"));
+    cArrowRecordBatchReader =
+      rb_const_get(rb_const_get(rb_cObject, rb_intern("Arrow")),
+                   rb_intern("RecordBatchReader"));
+    cArrowDatasetDataset =
+      rb_const_get(rb_const_get(rb_cObject, rb_intern("ArrowDataset")),
+                   rb_intern("Dataset"));
 
     auto mArrowDuckDB = rb_define_module("ArrowDuckDB");
+    rb_define_module_function(mArrowDuckDB,
+                              "open_ipc_file",
+                              arrow_duckdb_open_ipc_file,
+                              1);
     cArrowDuckDBResult = rb_define_class_under(mArrowDuckDB,
                                                "Result",
                                                rb_cObject);
     rb_define_alloc_func(cArrowDuckDBResult, result_alloc_func);
     rb_include_module(cArrowDuckDBResult, rb_mEnumerable);
+    rb_define_singleton_method(cArrowDuckDBResult,
+                               "from_table",
+                               result_s_from_table,
+                               1);
     rb_define_method(cArrowDuckDBResult, "fetch", result_fetch, 0);
     rb_define_method(cArrowDuckDBResult, "each", result_each, 0);
     rb_define_method(cArrowDuckDBResult, "schema", result_schema, 0);
@@ -374,16 +3485,172 @@ namespace {
                      "n_changed_rows",
                      result_n_changed_rows,
                      0);
+    rb_define_method(cArrowDuckDBResult, "to_table", result_to_table, -1);
+    rb_define_method(cArrowDuckDBResult, "profile", result_profile, 0);
+    rb_define_method(cArrowDuckDBResult,
+                     "memory_pool",
+                     result_memory_pool,
+                     0);
+    rb_define_method(cArrowDuckDBResult,
+                     "write_parquet",
+                     result_write_parquet,
+                     -1);
+    rb_define_method(cArrowDuckDBResult, "write_ipc", result_write_ipc, -1);
+    rb_define_method(cArrowDuckDBResult,
+                     "to_record_batch_reader",
+                     result_to_record_batch_reader,
+                     0);
+
+    cArrowDuckDBRegistration =
+      rb_define_class_under(mArrowDuckDB, "Registration", rb_cObject);
+    rb_undef_alloc_func(cArrowDuckDBRegistration);
+
+    auto cArrowDuckDBRecordBatchQueue =
+      rb_define_class_under(mArrowDuckDB, "RecordBatchQueue", rb_cObject);
+    rb_define_alloc_func(cArrowDuckDBRecordBatchQueue,
+                         record_batch_queue_alloc_func);
+    rb_define_method(cArrowDuckDBRecordBatchQueue,
+                     "initialize",
+                     record_batch_queue_initialize,
+                     -1);
+    rb_define_method(cArrowDuckDBRecordBatchQueue,
+                     "push",
+                     record_batch_queue_push,
+                     1);
+    rb_define_method(cArrowDuckDBRecordBatchQueue,
+                     "close",
+                     record_batch_queue_close,
+                     -1);
+    rb_define_method(cArrowDuckDBRecordBatchQueue,
+                     "reader",
+                     record_batch_queue_reader,
+                     0);
+
+    auto cArrowDuckDBSharedRegistrations =
+      rb_define_class_under(mArrowDuckDB, "SharedRegistrations", rb_cObject);
+    rb_define_alloc_func(cArrowDuckDBSharedRegistrations,
+                         shared_registrations_alloc_func);
+    rb_define_method(cArrowDuckDBSharedRegistrations,
+                     "register",
+                     shared_registrations_register,
+                     3);
+    rb_define_method(cArrowDuckDBSharedRegistrations,
+                     "unregister",
+                     shared_registrations_unregister,
+                     1);
+    rb_define_method(cArrowDuckDBSharedRegistrations,
+                     "attach",
+                     shared_registrations_attach,
+                     1);
+
+    cArrowDuckDBMemoryPool =
+      rb_define_class_under(mArrowDuckDB, "MemoryPool", rb_cObject);
+    rb_define_alloc_func(cArrowDuckDBMemoryPool, memory_pool_alloc_func);
+    rb_define_method(cArrowDuckDBMemoryPool,
+                     "initialize",
+                     memory_pool_initialize,
+                     -1);
+    rb_define_method(cArrowDuckDBMemoryPool,
+                     "bytes_allocated",
+                     memory_pool_bytes_allocated,
+                     0);
+    rb_define_method(cArrowDuckDBMemoryPool,
+                     "max_memory",
+                     memory_pool_max_memory,
+                     0);
+    rb_define_method(cArrowDuckDBMemoryPool,
+                     "total_bytes_allocated",
+                     memory_pool_total_bytes_allocated,
+                     0);
+    rb_define_method(cArrowDuckDBMemoryPool,
+                     "n_allocations",
+                     memory_pool_n_allocations,
+                     0);
+    rb_define_method(cArrowDuckDBMemoryPool,
+                     "backend_name",
+                     memory_pool_backend_name,
+                     0);
+    rb_define_method(cArrowDuckDBMemoryPool, "limit", memory_pool_limit, 0);
+    rb_define_method(cArrowDuckDBMemoryPool,
+                     "limit=",
+                     memory_pool_set_limit,
+                     1);
 
-    rb_define_method(cDuckDBConnection, "query_sql_arrow", query_sql_arrow, 1);
+    auto cArrowDuckDBResultCache =
+      rb_define_class_under(mArrowDuckDB, "ResultCache", rb_cObject);
+    rb_define_private_method(cArrowDuckDBResultCache,
+                             "table_n_bytes",
+                             result_cache_table_n_bytes,
+                             1);
+
+    cArrowDuckDBAsyncQuery =
+      rb_define_class_under(mArrowDuckDB, "AsyncQuery", rb_cObject);
+    rb_undef_alloc_func(cArrowDuckDBAsyncQuery);
+    rb_define_method(cArrowDuckDBAsyncQuery, "io", async_query_io, 0);
+    rb_define_method(cArrowDuckDBAsyncQuery, "done?", async_query_done_p, 0);
+    rb_define_method(cArrowDuckDBAsyncQuery, "wait", async_query_wait, 0);
+    rb_define_method(cArrowDuckDBAsyncQuery, "finish", async_query_finish, 0);
+    rb_define_method(cArrowDuckDBAsyncQuery, "cancel", async_query_cancel, 0);
+    async_queries = rb_hash_new();
+    rb_gc_register_address(&async_queries);
+    // GC doesn't call the mark function for nullptr.
+    rb_function_blocks = TypedData_Wrap_Struct(rb_cObject,
+                                               &function_blocks_type,
+                                               &function_blocks);
+    rb_gc_register_address(&rb_function_blocks);
+
+    rb_define_method(cDuckDBConnection,
+                     "query_sql_arrow",
+                     query_sql_arrow,
+                     -1);
+    rb_define_method(cDuckDBConnection,
+                     "query_sql_arrow_async",
+                     query_sql_arrow_async,
+                     -1);
     rb_define_method(cDuckDBConnection,
                      "register_arrow",
                      query_register_arrow,
-                     2);
+                     -1);
     rb_define_method(cDuckDBConnection,
                      "unregister_arrow",
                      query_unregister_arrow,
                      1);
+    rb_define_method(cDuckDBConnection,
+                     "insert_arrow",
+                     query_insert_arrow,
+                     -1);
+    rb_define_method(cDuckDBConnection,
+                     "arrow_scan_statistics",
+                     query_arrow_scan_statistics,
+                     1);
+    rb_define_private_method(cDuckDBConnection,
+                             "record_bound_arrow_names",
+                             query_record_bound_arrow_names,
+                             0);
+    rb_define_method(cDuckDBConnection,
+                     "register_arrow_function",
+                     query_register_arrow_function,
+                     -1);
+    rb_define_method(cDuckDBConnection,
+                     "arrow_sources",
+                     query_arrow_sources,
+                     0);
+    rb_define_method(cDuckDBConnection,
+                     "resolve_arrow_source",
+                     query_resolve_arrow_source,
+                     0);
+    rb_define_method(cDuckDBConnection,
+                     "arrow_memory_pool",
+                     connection_get_arrow_memory_pool,
+                     0);
+    rb_define_method(cDuckDBConnection,
+                     "arrow_memory_pool=",
+                     connection_set_arrow_memory_pool,
+                     1);
+    rb_define_private_method(cDuckDBConnection,
+                             "wait_arrow_async_queries",
+                             connection_wait_arrow_async_queries,
+                             0);
 
     auto cDuckDBPreparedStatement =
       rb_const_get(rb_const_get(rb_cObject, rb_intern("DuckDB")),
@@ -391,7 +3658,15 @@ namespace {
     rb_define_method(cDuckDBPreparedStatement,
                      "execute_arrow",
                      prepared_statement_execute_arrow,
-                     0);
+                     -1);
+    rb_define_method(cDuckDBPreparedStatement,
+                     "execute_arrow_async",
+                     prepared_statement_execute_arrow_async,
+                     -1);
+    rb_define_method(cDuckDBPreparedStatement,
+                     "execute_arrow_batch",
+                     prepared_statement_execute_arrow_batch,
+                     1);
   }
 }
 
@@ -33,9 +33,15 @@ required_pkg_config_package("arrow-glib",
                             debian: "libarrow-glib-dev",
                             redhat: "arrow-glib-devel",
                             homebrew: "apache-arrow-glib") or exit(false)
-required_pkg_config_package("arrow-dataset",
-                            debian: "libarrow-dataset-dev",
-                            redhat: "arrow-dataset-devel") or exit(false)
+required_pkg_config_package("arrow-dataset-glib",
+                            debian: "libarrow-dataset-glib-dev",
+                            redhat: "arrow-dataset-glib-devel",
+                            homebrew: "apache-arrow-glib") or exit(false)
+# For writing query results as Apache Parquet.
+required_pkg_config_package("parquet",
+                            debian: "libparquet-dev",
+                            redhat: "parquet-devel",
+                            homebrew: "apache-arrow") or exit(false)
 unless have_library("duckdb")
   install_missing_native_package(debian: "libduckdb-dev",
                                  redhat: "duckdb-devel",
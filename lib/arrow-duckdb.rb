@@ -13,11 +13,15 @@
 # limitations under the License.
 
 require "arrow"
+require "arrow-dataset"
 require "duckdb"
 
 require "arrow-duckdb/version"
 
 require "arrow_duckdb.so"
 
+require "arrow-duckdb/async-query"
 require "arrow-duckdb/connection"
-require "arrow-duckdb/result"
+require "arrow-duckdb/connection-pool"
+require "arrow-duckdb/prepared-statement"
+require "arrow-duckdb/result-cache"
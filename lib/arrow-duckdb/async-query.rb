@@ -0,0 +1,39 @@
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+require "io/wait"
+
+module ArrowDuckDB
+  class AsyncQuery
+    # Waits for the query and returns ArrowDuckDB::Result. Other
+    # fibers can run while waiting when Fiber.scheduler is set
+    # because this waits for #io.
+    #
+    # The query is canceled when the wait is interrupted by
+    # Timeout and so on.
+    def value
+      begin
+        io.wait_readable unless done?
+      rescue Exception
+        cancel
+        begin
+          finish
+        rescue DuckDB::Error
+        end
+        raise
+      end
+      finish
+    end
+  end
+end
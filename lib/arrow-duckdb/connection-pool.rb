@@ -0,0 +1,102 @@
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+require "etc"
+
+module ArrowDuckDB
+  # A thread-safe pool of connections to one DuckDB::Database.
+  #
+  # Apache Arrow data registered to a pool are visible to all pooled
+  # connections without copying. They are resolved as unknown table
+  # names in queries. So Ruby threads can query shared Apache Arrow
+  # data concurrently with query(..., output: :arrow), which releases
+  # the GVL.
+  #
+  # result_cache is an ArrowDuckDB::ResultCache for query(...,
+  # cache: true) of all pooled connections. It's cleared by
+  # #register and #unregister.
+  class ConnectionPool
+    class ClosedError < StandardError
+    end
+
+    attr_reader :size
+    def initialize(database, size: Etc.nprocessors, result_cache: nil)
+      @registrations = SharedRegistrations.new
+      @result_cache = result_cache
+      @size = size
+      @idle_connections = Thread::Queue.new
+      @size.times do
+        connection = database.connect
+        @registrations.attach(connection)
+        connection.arrow_result_cache = @result_cache
+        @idle_connections << connection
+      end
+    end
+
+    # Registers an Apache Arrow data to all connections. source is
+    # an Arrow::Table, an Arrow::RecordBatchReader, an
+    # ArrowDataset::Dataset or a path of an Arrow IPC file. statistics
+    # is the same as DuckDB::Connection#register_arrow.
+    #
+    # The data is alive while it's registered or a running query
+    # refers it.
+    def register(name, source, statistics: false)
+      if source.is_a?(String) or source.respond_to?(:to_path)
+        source = ArrowDuckDB.open_ipc_file(source)
+      end
+      @registrations.register(name, source, statistics)
+      @result_cache&.clear
+      return self unless block_given?
+
+      begin
+        yield
+      ensure
+        unregister(name)
+      end
+    end
+
+    def unregister(name)
+      @registrations.unregister(name)
+      @result_cache&.clear
+      self
+    end
+
+    # Yields an idle connection. This waits for an idle connection
+    # when all connections are used.
+    def with_connection
+      connection = @idle_connections.pop
+      raise ClosedError, "connection pool is closed" if connection.nil?
+      begin
+        yield(connection)
+      ensure
+        @idle_connections << connection unless @idle_connections.closed?
+      end
+    end
+
+    # Returns the result as an Arrow::Table because a result must not
+    # be used after the connection is returned to the pool.
+    def query(sql, *args, **options)
+      with_connection do |connection|
+        connection.query(sql, *args, output: :arrow, **options).to_table
+      end
+    end
+
+    # Waits for all connections and disconnects them.
+    def close
+      connections = @size.times.collect {@idle_connections.pop}
+      @idle_connections.close
+      connections.compact.each(&:disconnect)
+    end
+  end
+end
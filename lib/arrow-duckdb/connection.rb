@@ -14,16 +14,246 @@
 
 module ArrowDuckDB
   module ArrowableQuery
-    def query(sql, *args, output: nil)
+    # ArrowDuckDB::ResultCache used by query(..., cache: true). nil
+    # by default.
+    attr_accessor :arrow_result_cache
+
+    # The query is executed by query_async when Fiber.scheduler is
+    # set and output is :arrow. So it doesn't block other fibers.
+    #
+    # If profile is true, ArrowDuckDB::Result#profile returns the
+    # profile of the query.
+    #
+    # strings is the Arrow type of VARCHAR columns: :string (default),
+    # :large_string, :string_view or :dictionary. :dictionary reduces
+    # memory for low-cardinality columns. :large_string also uses
+    # 64-bit offsets for BLOB and LIST columns.
+    #
+    # memory_limit is the max number of bytes allocated by Apache
+    # Arrow for the query. It counts scans of registered Apache Arrow
+    # data and fetched record batches. DuckDB::Error is raised when
+    # the query exceeds it. See also arrow_memory_pool and
+    # ArrowDuckDB::Result#memory_pool.
+    #
+    # If cache is true and arrow_result_cache is set, the result is
+    # cached by the SQL, args, batch_size and strings. See
+    # ArrowDuckDB::ResultCache. cache is ignored when profile or
+    # stream is true or memory_limit is specified because a cached
+    # result has neither a profile, a stream nor memory accounting.
+    def query(sql,
+              *args,
+              output: nil,
+              stream: false,
+              batch_size: nil,
+              profile: false,
+              strings: nil,
+              memory_limit: nil,
+              cache: false)
       return super(sql, *args) if output != :arrow
 
-      return query_sql_arrow(sql) if args.empty?
+      options = {
+        stream: stream,
+        batch_size: batch_size,
+        profile: profile,
+        strings: strings,
+        memory_limit: memory_limit,
+      }
+      if cache and @arrow_result_cache and
+          not profile and not stream and memory_limit.nil?
+        key = [sql, args, batch_size, strings]
+        return @arrow_result_cache.fetch(key) do
+          result = nil
+          names = record_bound_arrow_names do
+            result = query(sql, *args, output: :arrow, **options)
+          end
+          [result, names]
+        end
+      end
+      if Fiber.respond_to?(:scheduler) and Fiber.scheduler
+        return query_async(sql, *args, **options).value
+      end
+      return query_sql_arrow(sql, **options) if args.empty?
 
       stmt = DuckDB::PreparedStatement.new(self, sql)
       args.each_with_index do |arg, i|
         stmt.bind(i + 1, arg)
       end
-      stmt.execute_arrow
+      stmt.execute_arrow(**options)
+    end
+
+    # Executes a query in a native thread and returns
+    # ArrowDuckDB::AsyncQuery immediately. AsyncQuery#value waits for
+    # the result. AsyncQuery#cancel interrupts the query.
+    #
+    # Only one query can be executed in a connection at a time. Async
+    # queries of the same connection run one by one. Use multiple
+    # connections for concurrent queries.
+    def query_async(sql,
+                    *args,
+                    stream: false,
+                    batch_size: nil,
+                    profile: false,
+                    strings: nil,
+                    memory_limit: nil)
+      options = {
+        stream: stream,
+        batch_size: batch_size,
+        profile: profile,
+        strings: strings,
+        memory_limit: memory_limit,
+      }
+      return query_sql_arrow_async(sql, **options) if args.empty?
+
+      stmt = DuckDB::PreparedStatement.new(self, sql)
+      args.each_with_index do |arg, i|
+        stmt.bind(i + 1, arg)
+      end
+      stmt.execute_arrow_async(**options)
+    end
+  end
+
+  module ArrowRegisterable
+    # Registers an Arrow data as a view.
+    #
+    # source is an Arrow::Table, an ArrowDataset::Dataset, an
+    # Arrow::RecordBatchReader, an Enumerable that yields
+    # Arrow::RecordBatch or a path of an Arrow IPC file. An Arrow IPC
+    # file is memory mapped and scanned in place without loading it
+    # to memory. An Arrow::RecordBatchReader and an
+    # Enumerable are streamed to DuckDB without buffering the whole
+    # data. They can be scanned only once.
+    #
+    # An Enumerable is iterated in a background thread. You need to
+    # use query(..., output: :arrow) to read it because other queries
+    # don't release the GVL. Other queries raise DuckDB::Error instead
+    # of a deadlock. The first record batch is read in
+    # register_arrow to detect schema unless schema is specified.
+    #
+    # If statistics is true, min/max/null count of each column of an
+    # Arrow::Table and the number of rows of an ArrowDataset::Dataset
+    # are computed at registration. DuckDB's optimizer uses them to
+    # choose join order and prune filters that never match.
+    def register_arrow(name,
+                       source,
+                       schema: nil,
+                       capacity: nil,
+                       statistics: false,
+                       &block)
+      source = open_ipc_file(source)
+      case source
+      when Arrow::Table, Arrow::RecordBatchReader, ArrowDataset::Dataset
+        super(name, source, statistics: statistics)
+      else
+        check_record_batches(source)
+        queue = feed_record_batches(source, schema, capacity)
+        begin
+          super(name, queue.reader)
+        rescue Exception
+          queue.close
+          raise
+        end
+        @arrow_record_batch_queues ||= {}
+        @arrow_record_batch_queues[name] = queue
+      end
+      @arrow_result_cache&.invalidate(name)
+      return self unless block
+
+      begin
+        yield
+      ensure
+        unregister_arrow(name)
+      end
+    end
+    alias_method :register, :register_arrow
+
+    # Inserts an Arrow data to table_name. source is the same as
+    # register_arrow. Record batches are streamed to DuckDB without
+    # creating a view.
+    #
+    # table_name may be qualified such as "schema.table" and
+    # "catalog.schema.table".
+    #
+    # If create is true and table_name doesn't exist, table_name is
+    # created from the schema of source.
+    #
+    # Returns the number of inserted rows.
+    def insert_arrow(table_name,
+                     source,
+                     create: true,
+                     schema: nil,
+                     capacity: nil)
+      source = open_ipc_file(source)
+      case source
+      when Arrow::Table, Arrow::RecordBatchReader, ArrowDataset::Dataset
+        return super(table_name, source, create: create)
+      end
+
+      check_record_batches(source)
+      queue = feed_record_batches(source, schema, capacity)
+      begin
+        super(table_name, queue.reader, create: create)
+      ensure
+        queue.close
+      end
+    end
+
+    def unregister_arrow(name)
+      queue = (@arrow_record_batch_queues || {}).delete(name)
+      # Stop the background thread that is waiting for a reader.
+      queue.close if queue
+      super
+    ensure
+      @arrow_result_cache&.invalidate(name)
+    end
+
+    private
+    def open_ipc_file(source)
+      if source.is_a?(String) or source.respond_to?(:to_path)
+        ArrowDuckDB.open_ipc_file(source)
+      else
+        source
+      end
+    end
+
+    def check_record_batches(source)
+      return if source.respond_to?(:each)
+      message = "must be Arrow::Table, Arrow::RecordBatchReader, " +
+                "ArrowDataset::Dataset, Enumerable of Arrow::RecordBatch " +
+                "or path of Arrow IPC file: " +
+                source.inspect
+      raise ArgumentError, message
+    end
+
+    def feed_record_batches(record_batches, schema, capacity)
+      queue = RecordBatchQueue.new(schema, capacity)
+      Thread.new do
+        begin
+          record_batches.each do |record_batch|
+            break unless queue.push(record_batch)
+          end
+          queue.close
+        rescue Exception => error
+          queue.close("#{error.class}: #{error.message}")
+        end
+      end
+      queue
+    end
+  end
+end
+
+module ArrowDuckDB
+  module AsyncQueryWaitable
+    # Waits for pending async queries before disconnecting. They use
+    # the connection in native threads. Use AsyncQuery#cancel not to
+    # wait for long queries.
+    def disconnect
+      wait_arrow_async_queries
+      super
+    end
+
+    def close
+      wait_arrow_async_queries
+      super
     end
   end
 end
@@ -31,7 +261,7 @@ end
 module DuckDB
   class Connection
     prepend ArrowDuckDB::ArrowableQuery
-
-    alias_method :register, :register_arrow
+    prepend ArrowDuckDB::ArrowRegisterable
+    prepend ArrowDuckDB::AsyncQueryWaitable
   end
 end
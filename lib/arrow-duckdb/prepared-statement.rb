@@ -1,4 +1,4 @@
-# Copyright 2021  Sutou Kouhei <kou@clear-code.com>
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
 #
 # Licensed under the Apache License, Version 2.0 (the "License");
 # you may not use this file except in compliance with the License.
@@ -13,9 +13,18 @@
 # limitations under the License.
 
 module ArrowDuckDB
-  class Result
-    def to_table
-      Arrow::Table.new(schema, to_a)
+  module ConnectionRememberable
+    # #execute_arrow uses this connection to interrupt the running
+    # query by Thread#raise and so on.
+    def initialize(connection, *args, **kwargs, &block)
+      super
+      @connection = connection
     end
   end
 end
+
+module DuckDB
+  class PreparedStatement
+    prepend ArrowDuckDB::ConnectionRememberable
+  end
+end
@@ -0,0 +1,139 @@
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+require "monitor"
+
+module ArrowDuckDB
+  # A size-bounded LRU cache of query results. Results are cached as
+  # Arrow::Table and cache hits read them without copying.
+  #
+  # Set a cache to connections by
+  # DuckDB::Connection#arrow_result_cache= and use query(...,
+  # output: :arrow, cache: true). A cached result is removed when
+  # register_arrow/unregister_arrow changes a registered Apache Arrow
+  # data bound by the query. Changes of DuckDB tables,
+  # ArrowDuckDB::ConnectionPool registrations and arrow_sources
+  # aren't tracked. Use #clear for them.
+  #
+  # A cache can be shared by connections that have the same
+  # registrations. This is thread-safe.
+  class ResultCache
+    Entry = Struct.new(:table, :n_bytes, :names)
+
+    attr_reader :max_bytes
+    def initialize(max_bytes:)
+      @max_bytes = max_bytes
+      @monitor = Monitor.new
+      @entries = {}
+      @n_bytes = 0
+      @n_hits = 0
+      @n_misses = 0
+      @n_evictions = 0
+      # This is incremented by each invalidation. A result computed
+      # while an invalidation isn't cached because it may be stale.
+      @generation = 0
+    end
+
+    # Returns ArrowDuckDB::Result of the cached table for key. The
+    # block is called on miss. It must return ArrowDuckDB::Result and
+    # names of registered Apache Arrow data bound by the query.
+    def fetch(key)
+      key = freeze_key(key)
+      table, generation = lookup(key)
+      return Result.from_table(table) if table
+
+      result, names = yield
+      table = result.to_table
+      store(key, table, names, generation)
+      Result.from_table(table)
+    end
+
+    # Removes cached results that bound name.
+    def invalidate(name)
+      name = name.to_s
+      @monitor.synchronize do
+        @generation += 1
+        @entries.delete_if do |_key, entry|
+          next false unless entry.names.include?(name)
+          @n_bytes -= entry.n_bytes
+          true
+        end
+      end
+      self
+    end
+
+    def clear
+      @monitor.synchronize do
+        @generation += 1
+        @entries.clear
+        @n_bytes = 0
+      end
+      self
+    end
+
+    def stats
+      @monitor.synchronize do
+        {
+          n_hits: @n_hits,
+          n_misses: @n_misses,
+          n_evictions: @n_evictions,
+          n_entries: @entries.size,
+          n_bytes: @n_bytes,
+        }
+      end
+    end
+
+    private
+    def freeze_key(key)
+      case key
+      when Array
+        key.collect {|element| freeze_key(element)}.freeze
+      else
+        key.frozen? ? key : key.dup.freeze
+      end
+    end
+
+    def lookup(key)
+      @monitor.synchronize do
+        entry = @entries.delete(key)
+        if entry
+          @n_hits += 1
+          # The last entry is the most recently used one.
+          @entries[key] = entry
+          [entry.table, @generation]
+        else
+          @n_misses += 1
+          [nil, @generation]
+        end
+      end
+    end
+
+    def store(key, table, names, generation)
+      n_bytes = table_n_bytes(table)
+      return if n_bytes > @max_bytes
+      @monitor.synchronize do
+        return if generation != @generation
+        old_entry = @entries.delete(key)
+        @n_bytes -= old_entry.n_bytes if old_entry
+        @entries[key] = Entry.new(table, n_bytes, names)
+        @n_bytes += n_bytes
+        while @n_bytes > @max_bytes
+          _key, entry = @entries.shift
+          @n_bytes -= entry.n_bytes
+          @n_evictions += 1
+        end
+      end
+    end
+  end
+end
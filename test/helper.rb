@@ -14,4 +14,7 @@
 
 require "arrow-duckdb"
 
+require "timeout"
+require "tmpdir"
+
 require "test-unit"
@@ -0,0 +1,63 @@
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+class TestConnectionPool < Test::Unit::TestCase
+  def setup
+    DuckDB::Database.open do |db|
+      @pool = ArrowDuckDB::ConnectionPool.new(db, size: 2)
+      begin
+        yield
+      ensure
+        @pool.close
+      end
+    end
+  end
+
+  test("#register") do
+    table = Arrow::Table.new("a" => [1, 2, 3])
+    @pool.register("data", table) do
+      threads = 4.times.collect do
+        Thread.new do
+          @pool.query("SELECT a FROM data WHERE a > 1")["a"].to_a
+        end
+      end
+      assert_equal([[2, 3]] * 4, threads.collect(&:value))
+    end
+  end
+
+  test("#unregister") do
+    @pool.register("data", Arrow::Table.new("a" => [1]))
+    @pool.unregister("data")
+    assert_raise(DuckDB::Error) do
+      @pool.query("SELECT * FROM data")
+    end
+  end
+
+  test("#with_connection") do
+    @pool.register("data", Arrow::Table.new("a" => [1, 2])) do
+      n_rows = @pool.with_connection do |connection|
+        connection.query("SELECT * FROM data", output: :arrow).to_table.n_rows
+      end
+      assert_equal(2, n_rows)
+    end
+  end
+
+  test("#close") do
+    @pool.close
+    assert_raise(ArrowDuckDB::ConnectionPool::ClosedError) do
+      @pool.with_connection {}
+    end
+  end
+end
@@ -38,12 +38,152 @@ class TestConnection < Test::Unit::TestCase
       assert_equal([Arrow::RecordBatch.new("name" => ["alice"])],
                    result.to_a)
     end
+
+    test("stream") do
+      @connection.query("CREATE TABLE numbers AS SELECT * FROM range(5000)")
+      result = @connection.query("SELECT * FROM numbers WHERE range < ?",
+                                 3000,
+                                 output: :arrow,
+                                 stream: true)
+      assert_equal(3000, result.sum(&:n_rows))
+    end
+
+    test("batch_size") do
+      result = @connection.query("SELECT * FROM range(?)",
+                                 10000,
+                                 output: :arrow,
+                                 batch_size: 3000)
+      assert_equal([3000, 3000, 3000, 1000],
+                   result.collect(&:n_rows))
+    end
+
+    test("interrupt") do
+      sql = "SELECT COUNT(*) FROM range(10000000000)"
+      assert_raise(Timeout::Error) do
+        Timeout.timeout(0.1) do
+          @connection.query(sql, output: :arrow)
+        end
+      end
+    end
   end
 
-  test("#query_sql_arrow") do
-    result = @connection.query_sql_arrow("SELECT 'data' AS string")
-    assert_equal([Arrow::RecordBatch.new("string" => ["data"])],
-                 result.to_a)
+  sub_test_case("#query_async") do
+    test("direct") do
+      async_query = @connection.query_async("SELECT 'data' AS string")
+      assert_equal([Arrow::RecordBatch.new("string" => ["data"])],
+                   async_query.value.to_a)
+    end
+
+    test("prepared statement") do
+      async_query = @connection.query_async("SELECT ? AS number", 29)
+      assert_equal([29], async_query.value.to_table["number"].to_a)
+    end
+
+    test("done?") do
+      async_query = @connection.query_async("SELECT 1")
+      async_query.value
+      assert do
+        async_query.done?
+      end
+    end
+
+    test("error") do
+      async_query = @connection.query_async("SELECT * FROM nonexistent")
+      assert_raise(DuckDB::Error) do
+        async_query.value
+      end
+    end
+
+    test("cancel") do
+      sql = "SELECT COUNT(*) FROM range(10000000000)"
+      async_query = @connection.query_async(sql)
+      sleep(0.1)
+      async_query.cancel
+      assert_raise(DuckDB::Error) do
+        async_query.value
+      end
+    end
+
+    test("cancel: pending") do
+      sql = "SELECT COUNT(*) FROM range(10000000000)"
+      running_async_query = @connection.query_async(sql)
+      pending_async_query = @connection.query_async("SELECT 1 AS value")
+      pending_async_query.cancel
+      running_async_query.cancel
+      assert_raise(DuckDB::Error) do
+        pending_async_query.value
+      end
+      assert_raise(DuckDB::Error) do
+        running_async_query.value
+      end
+    end
+
+    test("cancel: other query") do
+      sql = "SELECT COUNT(*) FROM range(100000000)"
+      async_query = @connection.query_async(sql)
+      canceled_async_query = @connection.query_async("SELECT 1 AS value")
+      canceled_async_query.cancel
+      assert_equal([100000000],
+                   async_query.value.to_table.columns[0].to_a)
+    end
+
+    test("disconnect") do
+      DuckDB::Database.open do |db|
+        connection = db.connect
+        async_query = connection.query_async("SELECT 29 AS value")
+        connection.disconnect
+        assert_equal([29], async_query.value.to_table["value"].to_a)
+      end
+    end
+
+    test("arrow_sources") do
+      @connection.arrow_sources["data"] = Arrow::Table.new("a" => [1, 2, 3])
+      async_query = @connection.query_async("SELECT a FROM data WHERE a > 1")
+      assert_equal([2, 3], async_query.value.to_table["a"].to_a)
+    end
+  end
+
+  sub_test_case("#query_sql_arrow") do
+    test("default") do
+      result = @connection.query_sql_arrow("SELECT 'data' AS string")
+      assert_equal([Arrow::RecordBatch.new("string" => ["data"])],
+                   result.to_a)
+    end
+
+    test("stream") do
+      result = @connection.query_sql_arrow("SELECT 'data' AS string",
+                                           stream: true)
+      assert_equal([Arrow::RecordBatch.new("string" => ["data"])],
+                   result.to_a)
+    end
+
+    test("batch_size") do
+      result = @connection.query_sql_arrow("SELECT * FROM range(10000)",
+                                           batch_size: 4096)
+      assert_equal([4096, 4096, 1808],
+                   result.collect(&:n_rows))
+    end
+
+    test("batch_size: stream") do
+      result = @connection.query_sql_arrow("SELECT * FROM range(10000)",
+                                           stream: true,
+                                           batch_size: 1000)
+      assert_equal([1000] * 10,
+                   result.collect(&:n_rows))
+    end
+
+    test("batch_size: invalid") do
+      assert_raise(ArgumentError) do
+        @connection.query_sql_arrow("SELECT 1", batch_size: 0)
+      end
+    end
+
+    test("stream: invalid") do
+      assert_raise(DuckDB::Error) do
+        @connection.query_sql_arrow("SELECT * FROM nonexistent",
+                                    stream: true)
+      end
+    end
   end
 
   test("#register") do
@@ -57,4 +197,313 @@ class TestConnection < Test::Unit::TestCase
                    result.to_a)
     end
   end
+
+  test("#register: dataset") do
+    Dir.mktmpdir do |dir|
+      Arrow::Table.new("a" => [1, 2, 3]).save(File.join(dir, "1.arrow"))
+      Arrow::Table.new("a" => [4, 5, 6]).save(File.join(dir, "2.arrow"))
+      dataset = ArrowDataset::FileSystemDataset.build(:arrow) do |factory|
+        factory.file_system_uri = URI("file://#{dir}")
+      end
+      @connection.register("data", dataset) do
+        result = @connection.query_sql_arrow("SELECT a FROM data WHERE a > 2")
+        assert_equal([3, 4, 5, 6],
+                     result.to_table["a"].to_a.sort)
+      end
+    end
+  end
+
+  sub_test_case("#register: IPC file") do
+    def setup
+      super do
+        Dir.mktmpdir do |dir|
+          @path = File.join(dir, "data.arrow")
+          @table = Arrow::Table.new("a" => [1, 2, 3],
+                                    "b" => ["x", "y", "z"])
+          @table.save(@path)
+          yield
+        end
+      end
+    end
+
+    test("String") do
+      @connection.register("data", @path) do
+        result = @connection.query_sql_arrow("SELECT * FROM data WHERE a > 1")
+        assert_equal(@table.slice(1, 2), result.to_table)
+      end
+    end
+
+    test("Pathname") do
+      @connection.register("data", Pathname(@path)) do
+        result = @connection.query_sql_arrow("SELECT b FROM data")
+        assert_equal(["x", "y", "z"], result.to_table["b"].to_a)
+      end
+    end
+
+    test("nonexistent") do
+      assert_raise(Arrow::Error::Io) do
+        @connection.register("data", "nonexistent.arrow")
+      end
+    end
+  end
+
+  sub_test_case("#insert_arrow") do
+    test("create") do
+      table = Arrow::Table.new("a" => [1, 2, 3],
+                               "b" => ["x", "y", "z"])
+      assert_equal(3, @connection.insert_arrow("data", table))
+      result = @connection.query_sql_arrow("SELECT * FROM data ORDER BY a")
+      assert_equal(table, result.to_table)
+    end
+
+    test("append") do
+      @connection.query("CREATE TABLE data (a BIGINT)")
+      @connection.insert_arrow("data", Arrow::Table.new("a" => [1, 2]))
+      @connection.insert_arrow("data", Arrow::Table.new("a" => [3]))
+      result = @connection.query_sql_arrow("SELECT a FROM data ORDER BY a")
+      assert_equal([1, 2, 3], result.to_table["a"].to_a)
+    end
+
+    test("enumerable") do
+      record_batches = [
+        Arrow::RecordBatch.new("a" => [1, 2]),
+        Arrow::RecordBatch.new("a" => [3]),
+      ]
+      assert_equal(3, @connection.insert_arrow("data", record_batches))
+    end
+
+    test("qualified name") do
+      @connection.query("CREATE SCHEMA s")
+      @connection.insert_arrow("s.data", Arrow::Table.new("a" => [1, 2]))
+      @connection.insert_arrow("memory.s.data", Arrow::Table.new("a" => [3]))
+      result = @connection.query_sql_arrow("SELECT a FROM s.data ORDER BY a")
+      assert_equal([1, 2, 3], result.to_table["a"].to_a)
+    end
+
+    test("create: false") do
+      assert_raise(DuckDB::Error) do
+        @connection.insert_arrow("nonexistent",
+                                 Arrow::Table.new("a" => [1]),
+                                 create: false)
+      end
+    end
+  end
+
+  sub_test_case("#register: statistics") do
+    def register(&block)
+      table = Arrow::Table.new("a" => [1, 2, nil, 3])
+      @connection.register("data", table, statistics: true, &block)
+    end
+
+    test("match") do
+      register do
+        result = @connection.query_sql_arrow("SELECT a FROM data WHERE a > 2")
+        assert_equal([3], result.to_table["a"].to_a)
+      end
+    end
+
+    test("never match") do
+      register do
+        result = @connection.query_sql_arrow("SELECT a FROM data WHERE a > 3")
+        assert_equal([
+                       [],
+                       nil,
+                     ],
+                     [
+                       result.to_table["a"].to_a,
+                       @connection.arrow_scan_statistics("data"),
+                     ])
+      end
+    end
+
+    test("NaN") do
+      table = Arrow::Table.new("a" => [1.0, Float::NAN])
+      @connection.register("data", table, statistics: true) do
+        result = @connection.query_sql_arrow("SELECT a FROM data WHERE a > 3")
+        assert_equal([true], result.to_table["a"].to_a.collect(&:nan?))
+      end
+    end
+  end
+
+  sub_test_case("#register: stream") do
+    def record_batches
+      [
+        Arrow::RecordBatch.new("a" => [1, 2, 3]),
+        Arrow::RecordBatch.new("a" => [4, 5, 6]),
+      ]
+    end
+
+    test("record batch reader") do
+      reader = Arrow::RecordBatchReader.new(record_batches)
+      @connection.register("data", reader) do
+        result = @connection.query_sql_arrow("SELECT sum(a) AS a FROM data")
+        assert_equal([21], result.to_table["a"].to_a)
+      end
+    end
+
+    test("enumerable") do
+      @connection.register("data", record_batches.each) do
+        result = @connection.query_sql_arrow("SELECT a FROM data WHERE a > 2")
+        assert_equal([3, 4, 5, 6],
+                     result.to_table["a"].to_a.sort)
+      end
+    end
+
+    test("enumerable: GVL held") do
+      @connection.register("data", record_batches.each) do
+        assert_raise(DuckDB::Error) do
+          @connection.query("SELECT a FROM data")
+        end
+      end
+    end
+
+    test("scan twice") do
+      @connection.register("data", record_batches.each) do
+        @connection.query_sql_arrow("SELECT * FROM data").to_table
+        assert_raise(DuckDB::Error) do
+          @connection.query_sql_arrow("SELECT * FROM data").to_table
+        end
+      end
+    end
+
+    test("error") do
+      enumerator = Enumerator.new do |yielder|
+        yielder << record_batches[0]
+        raise "broken"
+      end
+      @connection.register("data", enumerator) do
+        assert_raise(DuckDB::Error) do
+          @connection.query_sql_arrow("SELECT * FROM data").to_table
+        end
+      end
+    end
+  end
+
+  sub_test_case("#register_arrow_function") do
+    test("compute") do
+      @connection.register_arrow_function("arrow_add",
+                                          ["BIGINT", "BIGINT"],
+                                          "BIGINT",
+                                          compute: "add")
+      result = @connection.query_sql_arrow(<<-SQL)
+SELECT arrow_add(range, 10) AS a FROM range(3)
+      SQL
+      assert_equal([10, 11, 12], result.to_table["a"].to_a)
+    end
+
+    test("block") do
+      @connection.register_arrow_function("double_length",
+                                          ["VARCHAR"],
+                                          "INTEGER") do |strings|
+        Arrow::Int32Array.new(strings.collect {|s| s && s.size * 2})
+      end
+      result = @connection.query_sql_arrow(<<-SQL)
+SELECT double_length(s) AS a FROM (VALUES ('a'), (NULL), ('abc')) AS t(s)
+      SQL
+      assert_equal([2, nil, 6], result.to_table["a"].to_a)
+    end
+
+    test("cast output") do
+      @connection.register_arrow_function("one", ["BIGINT"], "DOUBLE") do |a|
+        Arrow::Int64Array.new([1] * a.length)
+      end
+      result = @connection.query_sql_arrow("SELECT one(range) AS a FROM range(2)")
+      assert_equal([1.0, 1.0], result.to_table["a"].to_a)
+    end
+
+    test("error") do
+      @connection.register_arrow_function("broken", ["BIGINT"], "BIGINT") do
+        raise "broken"
+      end
+      assert_raise(DuckDB::Error) do
+        @connection.query_sql_arrow("SELECT broken(range) FROM range(2)")
+      end
+    end
+
+    test("block: GVL held") do
+      @connection.register_arrow_function("one", ["BIGINT"], "BIGINT") do |a|
+        Arrow::Int64Array.new([1] * a.length)
+      end
+      @connection.query("SET threads = 4")
+      # DuckDB's worker threads call the block while the query holds
+      # the GVL.
+      assert_raise(DuckDB::Error) do
+        @connection.query("SELECT sum(one(range)) FROM range(10000000)")
+      end
+    end
+
+    test("built-in") do
+      assert_raise(DuckDB::Error) do
+        @connection.register_arrow_function("lower",
+                                            ["VARCHAR"],
+                                            "VARCHAR",
+                                            compute: "utf8_lower")
+      end
+    end
+
+    test("unknown compute function") do
+      assert_raise(ArgumentError) do
+        @connection.register_arrow_function("nonexistent",
+                                            ["BIGINT"],
+                                            "BIGINT",
+                                            compute: "nonexistent")
+      end
+    end
+  end
+
+  sub_test_case("#arrow_sources") do
+    test("string") do
+      @connection.arrow_sources["data"] = Arrow::Table.new("a" => [1, 2, 3])
+      result = @connection.query_sql_arrow("SELECT a FROM data WHERE a > 1")
+      assert_equal([2, 3], result.to_table["a"].to_a)
+    end
+
+    test("symbol") do
+      @connection.arrow_sources[:data] = Arrow::Table.new("a" => [1, 2, 3])
+      result = @connection.query_sql_arrow("SELECT a FROM data WHERE a > 1")
+      assert_equal([2, 3], result.to_table["a"].to_a)
+    end
+
+    test("replace") do
+      @connection.arrow_sources["data"] = Arrow::Table.new("a" => [1])
+      @connection.query_sql_arrow("SELECT a FROM data").to_table
+      @connection.arrow_sources["data"] = Arrow::Table.new("a" => [2])
+      result = @connection.query_sql_arrow("SELECT a FROM data")
+      assert_equal([2], result.to_table["a"].to_a)
+    end
+
+    test("no view") do
+      @connection.arrow_sources["data"] = Arrow::Table.new("a" => [1])
+      result = @connection.query_sql_arrow(<<-SQL)
+SELECT count(*) AS n FROM duckdb_views() WHERE view_name = 'data'
+      SQL
+      assert_equal([0], result.to_table["n"].to_a)
+    end
+
+    test("unknown") do
+      @connection.arrow_sources["data"] = Arrow::Table.new("a" => [1])
+      assert_raise(DuckDB::Error) do
+        @connection.query_sql_arrow("SELECT * FROM nonexistent")
+      end
+    end
+  end
+
+  sub_test_case("#resolve_arrow_source") do
+    test("block") do
+      @connection.resolve_arrow_source do |name|
+        Arrow::Table.new("name" => [name])
+      end
+      result = @connection.query_sql_arrow("SELECT name FROM data")
+      assert_equal(["data"], result.to_table["name"].to_a)
+    end
+
+    test("invalid source") do
+      @connection.resolve_arrow_source do |name|
+        name
+      end
+      assert_raise(DuckDB::Error) do
+        @connection.query_sql_arrow("SELECT * FROM data")
+      end
+    end
+  end
 end
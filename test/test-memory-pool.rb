@@ -0,0 +1,108 @@
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+class TestMemoryPool < Test::Unit::TestCase
+  def setup
+    DuckDB::Database.open do |db|
+      db.connect do |connection|
+        @connection = connection
+        yield
+      end
+    end
+  end
+
+  test(".new") do
+    pool = ArrowDuckDB::MemoryPool.new(backend: :system, limit: 1024)
+    assert_equal(["system", 1024, 0, 0],
+                 [
+                   pool.backend_name,
+                   pool.limit,
+                   pool.bytes_allocated,
+                   pool.max_memory,
+                 ])
+  end
+
+  test(".new: unknown backend") do
+    assert_raise_kind_of(Arrow::Error) do
+      ArrowDuckDB::MemoryPool.new(backend: :unknown)
+    end
+  end
+
+  test("#limit=") do
+    pool = ArrowDuckDB::MemoryPool.new(limit: 1024)
+    pool.limit = nil
+    assert_nil(pool.limit)
+  end
+
+  test("Connection#arrow_memory_pool") do
+    assert_equal([ArrowDuckDB::MemoryPool, true],
+                 [
+                   @connection.arrow_memory_pool.class,
+                   @connection.arrow_memory_pool.equal?(
+                     @connection.arrow_memory_pool),
+                 ])
+  end
+
+  test("Connection#arrow_memory_pool=") do
+    pool = ArrowDuckDB::MemoryPool.new(backend: :system)
+    @connection.arrow_memory_pool = pool
+    table = @connection.query_sql_arrow("SELECT * FROM range(1000)").to_table
+    # The table refers fetched record batches.
+    assert_equal([1000, true, "system"],
+                 [table.n_rows, pool.bytes_allocated > 0, pool.backend_name])
+  end
+
+  test("Result#memory_pool: result") do
+    result = @connection.query_sql_arrow("SELECT * FROM range(1000)")
+    table = result.to_table
+    memory_pool = result.memory_pool
+    # The table refers fetched record batches.
+    assert_equal([1000, true, true],
+                 [
+                   table.n_rows,
+                   memory_pool.bytes_allocated >= 1000 * 8,
+                   memory_pool.max_memory >= memory_pool.bytes_allocated,
+                 ])
+  end
+
+  test("Result#memory_pool: scan") do
+    table = Arrow::Table.new("a" => (1..1000).to_a)
+    @connection.register("data", table) do
+      result = @connection.query_sql_arrow("SELECT a FROM data WHERE a > 10")
+      result.to_table
+      assert do
+        result.memory_pool.total_bytes_allocated > 0
+      end
+    end
+  end
+
+  test("memory_limit:") do
+    sql = "SELECT * FROM range(100000)"
+    result = @connection.query_sql_arrow(sql, memory_limit: 1024)
+    assert_raise(DuckDB::Error) do
+      result.to_table
+    end
+  end
+
+  test("memory_limit: scan") do
+    table = Arrow::Table.new("a" => (1..100000).to_a)
+    @connection.register("data", table) do
+      assert_raise(DuckDB::Error) do
+        @connection.query_sql_arrow("SELECT a FROM data WHERE a > 10",
+                                    memory_limit: 1024)
+      end
+    end
+  end
+end
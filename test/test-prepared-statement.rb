@@ -31,4 +31,162 @@ class TestPreparedStatement < Test::Unit::TestCase
     assert_equal([Arrow::RecordBatch.new("name" => ["alice"])],
                  @prepared_statement.execute_arrow.to_a)
   end
+
+  test("#execute_arrow: stream") do
+    @prepared_statement.bind(1, "alice")
+    assert_equal([Arrow::RecordBatch.new("name" => ["alice"])],
+                 @prepared_statement.execute_arrow(stream: true).to_a)
+  end
+
+  test("#execute_arrow: interrupt") do
+    prepared_statement =
+      @connection.prepared_statement("SELECT COUNT(*) FROM range(?)")
+    prepared_statement.bind(1, 10000000000)
+    assert_raise(Timeout::Error) do
+      Timeout.timeout(0.1) do
+        prepared_statement.execute_arrow
+      end
+    end
+  end
+
+  sub_test_case("#execute_arrow_batch") do
+    test("default") do
+      params = Arrow::RecordBatch.new("name" => ["bob", "nobody", "alice"])
+      table = @prepared_statement.execute_arrow_batch(params)
+      assert_equal([
+                     ["row_index", "name"],
+                     [0, 2],
+                     ["bob", "alice"],
+                   ],
+                   [
+                     table.schema.fields.collect(&:name),
+                     table["row_index"].to_a,
+                     table["name"].to_a,
+                   ])
+    end
+
+    test("no rows") do
+      params = Arrow::RecordBatch.new("name" => Arrow::StringArray.new([]))
+      table = @prepared_statement.execute_arrow_batch(params)
+      assert_equal([
+                     Arrow::Schema.new([
+                                         Arrow::Field.new("row_index",
+                                                          :int64,
+                                                          false),
+                                         Arrow::Field.new("name", :string),
+                                       ]),
+                     0,
+                   ],
+                   [
+                     table.schema,
+                     table.n_rows,
+                   ])
+    end
+
+    test("timestamp with time zone") do
+      @connection.query("SET TimeZone = 'UTC'")
+      params = @connection.query(<<-SQL, output: :arrow).to_a.first
+SELECT TIMESTAMPTZ '2024-01-01 12:34:56+00' AS timestamp
+      SQL
+      prepared_statement =
+        @connection.prepared_statement("SELECT ?::VARCHAR AS timestamp")
+      table = prepared_statement.execute_arrow_batch(params)
+      assert_equal(["2024-01-01 12:34:56+00"], table["timestamp"].to_a)
+    end
+
+    test("timestamp before epoch") do
+      params = @connection.query(<<-SQL, output: :arrow).to_a.first
+SELECT '1969-12-31 23:59:59.999999999'::TIMESTAMP_NS AS timestamp
+      SQL
+      prepared_statement =
+        @connection.prepared_statement("SELECT ?::VARCHAR AS timestamp")
+      table = prepared_statement.execute_arrow_batch(params)
+      assert_equal(["1969-12-31 23:59:59.999999"], table["timestamp"].to_a)
+    end
+
+    test("date64") do
+      params = Arrow::RecordBatch.new("date" => Arrow::Date64Array.new([-1]))
+      prepared_statement =
+        @connection.prepared_statement("SELECT ?::VARCHAR AS date")
+      table = prepared_statement.execute_arrow_batch(params)
+      assert_equal(["1969-12-31"], table["date"].to_a)
+    end
+
+    test("time32") do
+      time = Arrow::Int32Array.new([3723004])
+      time = time.cast(Arrow::Time32DataType.new(:milli))
+      params = Arrow::RecordBatch.new("time" => time)
+      prepared_statement =
+        @connection.prepared_statement("SELECT ?::VARCHAR AS time")
+      table = prepared_statement.execute_arrow_batch(params)
+      assert_equal(["01:02:03.004"], table["time"].to_a)
+    end
+
+    test("time64") do
+      params = @connection.query(<<-SQL, output: :arrow).to_a.first
+SELECT TIME '01:02:03.004005' AS time
+      SQL
+      prepared_statement =
+        @connection.prepared_statement("SELECT ?::VARCHAR AS time")
+      table = prepared_statement.execute_arrow_batch(params)
+      assert_equal(["01:02:03.004005"], table["time"].to_a)
+    end
+
+    test("decimal128") do
+      params = @connection.query(<<-SQL, output: :arrow).to_a.first
+SELECT -12.345::DECIMAL(20, 3) AS decimal
+      SQL
+      prepared_statement =
+        @connection.prepared_statement("SELECT ?::VARCHAR AS decimal")
+      table = prepared_statement.execute_arrow_batch(params)
+      assert_equal(["-12.345"], table["decimal"].to_a)
+    end
+
+    test("large binary") do
+      params =
+        Arrow::RecordBatch.new("binary" => Arrow::LargeBinaryArray.new(["ab"]))
+      prepared_statement =
+        @connection.prepared_statement("SELECT octet_length(?) AS size")
+      table = prepared_statement.execute_arrow_batch(params)
+      assert_equal([2], table["size"].to_a)
+    end
+
+    test("dictionary") do
+      names = Arrow::StringArray.new(["bob", "nobody", "alice"])
+      params = Arrow::RecordBatch.new("name" => names.dictionary_encode)
+      table = @prepared_statement.execute_arrow_batch(params)
+      assert_equal([[0, 2], ["bob", "alice"]],
+                   [table["row_index"].to_a, table["name"].to_a])
+    end
+
+    test("unsupported type") do
+      params = @connection.query(<<-SQL, output: :arrow).to_a.first
+SELECT [1, 2] AS name
+      SQL
+      error = assert_raise(Arrow::Error::NotImplemented) do
+        @prepared_statement.execute_arrow_batch(params)
+      end
+      assert_match(/: column <0>: name <name>: row <0>: type <list<.+>>\z/,
+                   error.message)
+    end
+
+    test("interrupt") do
+      prepared_statement =
+        @connection.prepared_statement("SELECT COUNT(*) FROM range(?)")
+      params = Arrow::RecordBatch.new("n" => [10000000] * 100000)
+      assert_raise(Timeout::Error) do
+        Timeout.timeout(0.1) do
+          prepared_statement.execute_arrow_batch(params)
+        end
+      end
+    end
+
+    test("wrong number of columns") do
+      params = Arrow::RecordBatch.new("name" => ["bob"],
+                                      "age" => [29])
+      assert_raise(Arrow::Error::Invalid) do
+        @prepared_statement.execute_arrow_batch(params)
+      end
+    end
+  end
 end
@@ -39,4 +39,137 @@ SELECT value FROM data WHERE value >= '2022-03-05'
                    result.to_table)
     end
   end
+
+  def register(sql)
+    table = @connection.query_sql_arrow(sql).to_table
+    @connection.register("data", table) do
+      yield
+    end
+  end
+
+  def select_values(condition)
+    sql = "SELECT value FROM data WHERE #{condition} ORDER BY value"
+    @connection.query_sql_arrow(sql).to_table["value"].to_a
+  end
+
+  test("date") do
+    register(<<-SQL) do
+SELECT * FROM (VALUES (DATE '2022-03-04'),
+                      (DATE '2022-03-05'),
+                      (DATE '2022-03-06')) AS t(value)
+    SQL
+      assert_equal([Date.new(2022, 3, 5), Date.new(2022, 3, 6)],
+                   select_values("value >= DATE '2022-03-05'"))
+    end
+  end
+
+  test("time") do
+    register(<<-SQL) do
+SELECT * FROM (VALUES (TIME '01:00:00'),
+                      (TIME '02:00:00'),
+                      (TIME '03:00:00')) AS t(value)
+    SQL
+      assert_equal(1, select_values("value < TIME '02:00:00'").size)
+    end
+  end
+
+  test("date64") do
+    table = Arrow::Table.new("value" => Arrow::Date64Array.new([
+                                                                Date.new(2022, 3, 4),
+                                                                Date.new(2022, 3, 5),
+                                                                Date.new(2022, 3, 6),
+                                                              ]))
+    @connection.register("data", table) do
+      assert_equal([Date.new(2022, 3, 5), Date.new(2022, 3, 6)],
+                   select_values("value >= DATE '2022-03-05'"))
+    end
+  end
+
+  test("time32") do
+    table = Arrow::Table.new("value" => Arrow::Time32Array.new(:second,
+                                                               [
+                                                                 60 * 60,
+                                                                 2 * 60 * 60,
+                                                                 3 * 60 * 60,
+                                                               ]))
+    @connection.register("data", table) do
+      assert_equal(2,
+                   select_values("value >= TIME '01:30:00' AND " +
+                                 "value <= TIME '03:00:00'").size)
+    end
+  end
+
+  test("decimal") do
+    register(<<-SQL) do
+SELECT value::DECIMAL(10, 2) AS value
+  FROM (VALUES (99.99), (100.00), (100.01), (250.50)) AS t(value)
+    SQL
+      assert_equal([BigDecimal("100.01"), BigDecimal("250.50")],
+                   select_values("value > 100.00"))
+    end
+  end
+
+  test("hugeint") do
+    register(<<-SQL) do
+SELECT * FROM (VALUES (1::HUGEINT), (2::HUGEINT), (3::HUGEINT)) AS t(value)
+    SQL
+      assert_equal(2, select_values("value >= 2").size)
+    end
+  end
+
+  test("not equal") do
+    register(<<-SQL) do
+SELECT * FROM (VALUES ('a'), ('x'), ('b'), (NULL)) AS t(value)
+    SQL
+      assert_equal(["a", "b"],
+                   select_values("value <> 'x'"))
+    end
+  end
+
+  test("in") do
+    register("SELECT range AS value FROM range(10)") do
+      assert_equal([1, 3, 5],
+                   select_values("value IN (1, 3, 5)"))
+    end
+  end
+
+  test("or of equalities") do
+    register("SELECT range AS value FROM range(10)") do
+      assert_equal([2, 7],
+                   select_values("value = 2 OR value = 7"))
+    end
+  end
+
+  test("cached filter") do
+    register("SELECT range AS value FROM range(10)") do
+      assert_equal([
+                     [8, 9],
+                     [8, 9],
+                     [9],
+                   ],
+                   [
+                     select_values("value > 7"),
+                     select_values("value > 7"),
+                     select_values("value > 8"),
+                   ])
+    end
+  end
+
+  test("partial") do
+    register(<<-SQL) do
+SELECT range AS value, ('x' || range)::BLOB AS blob FROM range(5)
+    SQL
+      assert_equal([2, 4],
+                   select_values("value >= 2 AND blob <> 'x3'::BLOB"))
+      statistics = @connection.arrow_scan_statistics("data")
+      assert_equal({
+                     n_pushed_filters: 1,
+                     n_rows: 3,
+                   },
+                   {
+                     n_pushed_filters: statistics[:pushed_filters].size,
+                     n_rows: statistics[:n_rows],
+                   })
+    end
+  end
 end
@@ -0,0 +1,146 @@
+# Copyright 2026  Sutou Kouhei <kou@clear-code.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+class TestResultCache < Test::Unit::TestCase
+  def setup
+    DuckDB::Database.open do |db|
+      db.connect do |connection|
+        @connection = connection
+        @cache = ArrowDuckDB::ResultCache.new(max_bytes: 1024 * 1024)
+        @connection.arrow_result_cache = @cache
+        yield
+      end
+    end
+  end
+
+  def query(sql, *args)
+    @connection.query(sql, *args, output: :arrow, cache: true)
+  end
+
+  test("hit") do
+    @connection.register("data", Arrow::Table.new("a" => [1, 2, 3])) do
+      sql = "SELECT a FROM data WHERE a > ?"
+      tables = [
+        query(sql, 1).to_table,
+        query(sql, 1).to_table,
+        query(sql, 2).to_table,
+      ]
+      assert_equal([
+                     [[2, 3], [2, 3], [3]],
+                     {
+                       n_hits: 1,
+                       n_misses: 2,
+                       n_evictions: 0,
+                       n_entries: 2,
+                     },
+                   ],
+                   [
+                     tables.collect {|table| table["a"].to_a},
+                     @cache.stats.except(:n_bytes),
+                   ])
+    end
+  end
+
+  test("cached result") do
+    query("SELECT 29 AS number")
+    result = query("SELECT 29 AS number")
+    assert_equal([
+                   1,
+                   1,
+                   Arrow::Table.new("number" => Arrow::Int32Array.new([29])),
+                 ],
+                 [
+                   result.n_columns,
+                   result.n_rows,
+                   result.to_table,
+                 ])
+  end
+
+  test("without cache:") do
+    @connection.query("SELECT 29", output: :arrow)
+    assert_equal(0, @cache.stats[:n_misses])
+  end
+
+  test("invalidate: register") do
+    sql = "SELECT sum(a) AS total FROM data"
+    @connection.register("data", Arrow::Table.new("a" => [1, 2, 3])) do
+      query(sql)
+    end
+    @connection.register("data", Arrow::Table.new("a" => [10, 20])) do
+      assert_equal([30], query(sql).to_table["total"].to_a)
+    end
+  end
+
+  test("invalidate: not scanned") do
+    sql = "SELECT sum(a) AS total FROM data"
+    @connection.register("data", Arrow::Table.new("a" => [1, 2, 3])) do
+      query(sql)
+      @connection.register("other", Arrow::Table.new("b" => [1])) do
+      end
+      query(sql)
+    end
+    assert_equal([1, 1],
+                 [@cache.stats[:n_hits], @cache.stats[:n_entries]])
+  end
+
+  test("invalidate: LIMIT 0") do
+    sql = "SELECT * FROM data LIMIT 0"
+    @connection.register("data", Arrow::Table.new("a" => [1])) do
+      query(sql)
+    end
+    @connection.register("data", Arrow::Table.new("b" => [1])) do
+      assert_equal(["b"], query(sql).to_table.schema.fields.collect(&:name))
+    end
+  end
+
+  test("stream") do
+    @connection.query("SELECT 29", output: :arrow, stream: true, cache: true)
+    assert_equal(0, @cache.stats[:n_misses])
+  end
+
+  test("memory_limit") do
+    @connection.query("SELECT 29",
+                      output: :arrow,
+                      memory_limit: 1024 * 1024,
+                      cache: true)
+    assert_equal(0, @cache.stats[:n_misses])
+  end
+
+  test("evict") do
+    sql = "SELECT range AS number FROM range(?)"
+    query(sql, 100_000)
+    n_bytes = @cache.stats[:n_bytes]
+    cache = ArrowDuckDB::ResultCache.new(max_bytes: n_bytes * 3 / 2)
+    @connection.arrow_result_cache = cache
+    query(sql, 100_000)
+    query(sql, 100_001)
+    query(sql, 100_000)
+    assert_equal({
+                   n_hits: 0,
+                   n_misses: 3,
+                   n_evictions: 2,
+                   n_entries: 1,
+                 },
+                 cache.stats.except(:n_bytes))
+  end
+
+  test("#clear") do
+    query("SELECT 29")
+    @cache.clear
+    query("SELECT 29")
+    assert_equal({n_hits: 0, n_misses: 2, n_entries: 1},
+                 @cache.stats.slice(:n_hits, :n_misses, :n_entries))
+  end
+end
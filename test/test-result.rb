@@ -64,9 +64,267 @@ class TestResult < Test::Unit::TestCase
     assert_equal(0, @result.n_changed_rows)
   end
 
-  test("#to_table") do
+  sub_test_case("stream") do
+    def query
+      sql = "SELECT range AS number FROM range(5000)"
+      @connection.query_sql_arrow(sql, stream: true)
+    end
+
+    test("#fetch") do
+      result = query
+      n_rows = 0
+      while (record_batch = result.fetch)
+        n_rows += record_batch.n_rows
+      end
+      assert_equal(5000, n_rows)
+    end
+
+    test("#schema") do
+      assert_equal(Arrow::Schema.new("number" => Arrow::Int64DataType.new),
+                   query.schema)
+    end
+
+    test("#schema: same as not streaming") do
+      sql = <<-SQL
+SELECT 1::TINYINT AS tinyint,
+       1::HUGEINT AS hugeint,
+       1.5::DECIMAL(10, 2) AS decimal,
+       'data' AS varchar,
+       '\\xAA'::BLOB AS blob,
+       DATE '2024-01-01' AS date,
+       TIME '12:34:56' AS time,
+       TIMESTAMP '2024-01-01 12:34:56' AS timestamp,
+       TIMESTAMP_MS '2024-01-01 12:34:56' AS timestamp_ms,
+       TIMESTAMPTZ '2024-01-01 12:34:56+00' AS timestamp_tz,
+       [1, 2] AS list,
+       {'a': 1, 'b': 'x'} AS struct,
+       MAP {'a': 1} AS map,
+       'x'::ENUM('x', 'y') AS enum,
+       INTERVAL 1 DAY AS interval,
+       '00000000-0000-0000-0000-000000000000'::UUID AS uuid
+      SQL
+      assert_equal(@connection.query_sql_arrow(sql).schema,
+                   @connection.query_sql_arrow(sql, stream: true).schema)
+    end
+
+    test("#n_columns") do
+      assert_equal(1, query.n_columns)
+    end
+
+    test("#n_rows") do
+      assert_nil(query.n_rows)
+    end
+
+    test("#fetch: concurrently") do
+      result = @connection.query_sql_arrow("SELECT * FROM range(100000)",
+                                           stream: true)
+      threads = 4.times.collect do
+        Thread.new do
+          numbers = []
+          while (record_batch = result.fetch)
+            numbers.concat(record_batch["range"].to_a)
+          end
+          numbers
+        end
+      end
+      numbers = threads.collect(&:value).flatten
+      assert_equal((0...100000).to_a, numbers.sort)
+    end
+  end
+
+  sub_test_case("#to_table") do
+    test("default") do
+      assert_equal(Arrow::Table.new("number" => Arrow::Int32Array.new([29]),
+                                    "string" => ["data"]),
+                   @result.to_table)
+    end
+
+    test("combine_chunks: true") do
+      result = @connection.query_sql_arrow("SELECT * FROM range(5000)")
+      table = result.to_table(combine_chunks: true)
+      assert_equal([5000, 1],
+                   [table.n_rows, table["range"].data.n_chunks])
+    end
+  end
+
+  test("#to_record_batch_reader") do
+    reader = @result.to_record_batch_reader
     assert_equal(Arrow::Table.new("number" => Arrow::Int32Array.new([29]),
                                   "string" => ["data"]),
-                 @result.to_table)
+                 reader.read_all)
+  end
+
+  sub_test_case("#profile") do
+    test("disabled") do
+      assert_nil(@result.profile)
+    end
+
+    test("enabled") do
+      result = @connection.query_sql_arrow("SELECT * FROM range(5000)",
+                                           profile: true)
+      result.to_table
+      profile = result.profile
+      assert_equal([
+                     [:duckdb, :execute, :fetch, :scans],
+                     5000,
+                     String,
+                   ],
+                   [
+                     profile.keys.sort,
+                     profile[:fetch][:n_rows],
+                     profile[:duckdb].class,
+                   ])
+    end
+
+    test("scans") do
+      table = Arrow::Table.new("a" => [1, 2, 3, 4])
+      @connection.register("data", table) do
+        result = @connection.query_sql_arrow("SELECT a FROM data WHERE a > 2",
+                                             profile: true)
+        result.to_table
+        scan = result.profile[:scans]["data"]
+        assert_equal([2, 2],
+                     [scan[:n_rows], scan[:n_removed_rows]])
+      end
+    end
+
+    test("scans: threads") do
+      table = Arrow::Table.new("a" => (0...32768).to_a)
+      @connection.register("data", table) do
+        n_batches = [1, 4].collect do |n_threads|
+          @connection.query("SET threads = #{n_threads}")
+          result = @connection.query_sql_arrow("SELECT SUM(a) FROM data",
+                                               profile: true)
+          result.to_table
+          result.profile[:scans]["data"][:n_batches]
+        end
+        assert_equal([4, 16], n_batches)
+      end
+    end
+
+    test("scans: partitions") do
+      values = (0...32768).to_a
+      table = Arrow::Table.new("a" => values)
+      @connection.register("data", table) do
+        @connection.query("SET threads = 4")
+        result = @connection.query_sql_arrow("SELECT a FROM data",
+                                             profile: true)
+        assert_equal([values, 32768],
+                     [
+                       result.to_table["a"].to_a,
+                       result.profile[:scans]["data"][:n_rows],
+                     ])
+      end
+    end
+  end
+
+  sub_test_case("strings:") do
+    def query(strings, **options)
+      sql = <<-SQL
+SELECT ['a', 'b', 'a'][range % 3 + 1] AS string, range AS number
+  FROM range(3)
+      SQL
+      @connection.query_sql_arrow(sql, strings: strings, **options)
+    end
+
+    test(":string") do
+      table = query(:string).to_table
+      assert_equal([Arrow::StringDataType, ["a", "b", "a"]],
+                   [table["string"].data_type.class, table["string"].to_a])
+    end
+
+    test(":large_string") do
+      table = query(:large_string).to_table
+      assert_equal([Arrow::LargeStringDataType, ["a", "b", "a"]],
+                   [table["string"].data_type.class, table["string"].to_a])
+    end
+
+    test(":string_view") do
+      table = query(:string_view).to_table
+      assert_equal([Arrow::StringViewDataType, ["a", "b", "a"]],
+                   [table["string"].data_type.class, table["string"].to_a])
+    end
+
+    test(":dictionary") do
+      result = query(:dictionary, stream: true, batch_size: 2)
+      table = result.to_table
+      assert_equal([
+                     Arrow::DictionaryDataType,
+                     Arrow::DictionaryDataType,
+                     ["a", "b", "a"],
+                     [0, 1, 2],
+                   ],
+                   [
+                     result.schema[:string].data_type.class,
+                     table["string"].data_type.class,
+                     table["string"].to_a,
+                     table["number"].to_a,
+                   ])
+    end
+
+    test("invalid") do
+      assert_raise(ArgumentError) do
+        query(:unknown)
+      end
+    end
+  end
+
+  sub_test_case("write") do
+    def setup
+      super do
+        Dir.mktmpdir do |dir|
+          @dir = dir
+          yield
+        end
+      end
+    end
+
+    def query
+      sql = "SELECT range AS number FROM range(5000)"
+      @connection.query_sql_arrow(sql, stream: true)
+    end
+
+    test("#write_parquet") do
+      path = File.join(@dir, "result.parquet")
+      n_rows = query.write_parquet(path,
+                                   row_group_size: 1000,
+                                   compression: :zstd)
+      n_row_groups_sql = <<-SQL
+SELECT count(DISTINCT row_group_id) AS n FROM parquet_metadata('#{path}')
+      SQL
+      numbers_sql = "SELECT number FROM read_parquet('#{path}') ORDER BY number"
+      assert_equal([5000, 5, (0...5000).to_a],
+                   [
+                     n_rows,
+                     @connection.query_sql_arrow(n_row_groups_sql)
+                       .to_table["n"][0],
+                     @connection.query_sql_arrow(numbers_sql)
+                       .to_table["number"].to_a,
+                   ])
+    end
+
+    test("#write_ipc") do
+      path = File.join(@dir, "result.arrow")
+      assert_equal(5000, query.write_ipc(path, compression: :lz4))
+      assert_equal((0...5000).to_a,
+                   Arrow::Table.load(path)["number"].to_a)
+    end
+
+    test("failure") do
+      path = File.join(@dir, "result.arrow")
+      query.write_ipc(path)
+      sql = <<-SQL
+SELECT CASE WHEN range < 4000 THEN range ELSE error('failure') END AS number
+  FROM range(5000)
+      SQL
+      assert_raise(DuckDB::Error) do
+        @connection.query_sql_arrow(sql, stream: true).write_ipc(path)
+      end
+      assert_equal([(0...5000).to_a, ["result.arrow"]],
+                   [
+                     Arrow::Table.load(path)["number"].to_a,
+                     Dir.children(@dir),
+                   ])
+    end
   end
 end